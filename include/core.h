@@ -182,6 +182,8 @@ ErrorCode EndQuery(QueryID query_id);
  *   "doc_str" contains at least one non-space character.
  *   "doc_str" contains only lower case letters from 'a' to 'z'
  *   and space characters.
+ *   The document is tokenized before the call returns and only its
+ *   distinct words are kept, so the caller can reuse doc_str right away.
  *
  *   @return ErrorCode
  *   - \ref EC_SUCCESS
@@ -189,6 +191,18 @@ ErrorCode EndQuery(QueryID query_id);
  */
 ErrorCode MatchDocument(DocID doc_id, const char *doc_str);
 
+/**
+ * Same as MatchDocument() for callers that can hand the document over. The
+ * core library takes ownership of doc_str, which must have been allocated
+ * with malloc(), and frees it once its words have been read. The document is
+ * tokenized by the thread that matches it instead of the caller.
+ *
+ * @return ErrorCode
+ *   - \ref EC_SUCCESS
+ *          if the document was added successfully
+ */
+ErrorCode MatchDocumentOwned(DocID doc_id, char *doc_str);
+
 /**
  * Return the next available active queries subset that matches any previously
  * submitted document, sorted by query IDs. The returned result must depend
@@ -222,6 +236,96 @@ ErrorCode MatchDocument(DocID doc_id, const char *doc_str);
 ErrorCode GetNextAvailRes(DocID *p_doc_id, unsigned int *p_num_res,
                           QueryID **p_query_ids);
 
+/**
+ * The results of one document as returned by GetNextAvailResBatch().
+ */
+typedef struct DocResult {
+  DocID doc_id;
+  unsigned int num_res;
+  /**
+   * The num_res matching query IDs ordered by value, or NULL if num_res is 0.
+   * The array is owned by the core library.
+   */
+  const QueryID *query_ids;
+} DocResult;
+
+/**
+ * Batch version of GetNextAvailRes() for high throughput consumers. Returns
+ * the results of up to max_docs documents that have not been returned before
+ * by either function, with one trip through the finished queue and without
+ * allocating anything per document.
+ *
+ * The query ID arrays are not allocated with malloc() and must not be freed.
+ * They stay valid until the next call to GetNextAvailResBatch().
+ *
+ * @param[out] results
+ *   A caller provided buffer of at least max_docs entries.
+ *
+ * @param[in] max_docs
+ *   The maximum number of documents to return. Must be at least 1.
+ *
+ * @param[out] p_num_docs
+ *   The number of entries of results that were filled in.
+ *
+ * @return ErrorCode
+ *   - \ref EC_NO_AVAIL_RES
+ *          if all documents have already been returned
+ *   - \ref EC_SUCCESS
+ *          at least one result was returned. Blocks until the first
+ *          document that is still being matched is finished
+ */
+ErrorCode GetNextAvailResBatch(DocResult *results, unsigned int max_docs,
+                               unsigned int *p_num_docs);
+
+/**
+ * Turns the metrics of the core on or off. They are off by default, which
+ * costs one branch per measurement. While they are on the core counts the
+ * documents, the answers, the match cache lookups and the distance function
+ * calls, and keeps latency histograms of every stage of MatchDocument(), of
+ * the matching job and of the wait in GetNextAvailRes(). Setting the
+ * SEARCH_METRICS environment variable to 1 turns them on in InitializeIndex().
+ *
+ * @param[in] enabled
+ *   Non zero to record metrics.
+ *
+ * @return ErrorCode
+ *   - \ref EC_FAIL
+ *          if the library was built without metrics
+ *   - \ref EC_SUCCESS
+ *          otherwise
+ */
+ErrorCode EnableMetrics(int enabled);
+
+/**
+ * Zeroes every metric.
+ */
+ErrorCode ResetMetrics();
+
+/**
+ * Writes every metric as text to a file descriptor, one per line:
+ *
+ *   counter <name> <value>
+ *   histogram <name> count=<n> mean=<v> p50=<v> p90=<v> p99=<v> p999=<v> max=<v>
+ *
+ * It neither allocates nor locks, so it can be called from a signal handler
+ * and while documents are being matched, in which case the values are
+ * approximate.
+ */
+ErrorCode DumpMetrics(int fd);
+
+/**
+ * Installs a handler that calls DumpMetrics(fd) every time the process gets
+ * signum, e.g. SIGUSR1. The SEARCH_METRICS_SIGNAL environment variable does
+ * the same with fd 2 in InitializeIndex().
+ *
+ * @return ErrorCode
+ *   - \ref EC_FAIL
+ *          if the handler could not be installed
+ *   - \ref EC_SUCCESS
+ *          otherwise
+ */
+ErrorCode DumpMetricsOnSignal(int signum, int fd);
+
 ///////////////////////////////////////////////////////////////////////////////////////////////
 //*********************************************************************************************
 
@@ -0,0 +1,111 @@
+#ifndef QS_ARENA_HPP
+#define QS_ARENA_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <utility>
+
+#include <qs/core.h>
+
+namespace qs {
+
+#define QS_ARENA_BLOCK_SIZE (64 * 1024)
+
+// A bump allocator. Allocations are carved out of big blocks and are never
+// freed one by one. reset() drops every allocation at once but keeps the
+// blocks, so an arena that is reused stops calling malloc once it has warmed
+// up.
+//
+// The arena only owns memory: objects that live in it and are not trivially
+// destructible must still be destroyed before reset(). It is not thread safe.
+class arena {
+  struct block {
+    block *next;
+    std::size_t capacity;
+
+    char *data() { return reinterpret_cast<char *>(this + 1); }
+  };
+
+  std::size_t block_size;
+  block *head = nullptr;
+  block *tail = nullptr;
+  block *current = nullptr;
+  std::size_t used = 0;
+  std::size_t capacity = 0;
+
+  // Moves to the next block that can hold min_size bytes, allocating a new
+  // one at the end of the list if there is none
+  void next_block(std::size_t min_size) {
+    block *b = current != nullptr ? current->next : head;
+    while (b != nullptr && b->capacity < min_size) {
+      b = b->next;
+    }
+    if (b == nullptr) {
+      std::size_t size = min_size > block_size ? min_size : block_size;
+      b = static_cast<block *>(::operator new(sizeof(block) + size));
+      b->next = nullptr;
+      b->capacity = size;
+      if (tail != nullptr) {
+        tail->next = b;
+      } else {
+        head = b;
+      }
+      tail = b;
+      capacity += size;
+    }
+    current = b;
+    used = 0;
+  }
+
+public:
+  explicit arena(std::size_t block_size = QS_ARENA_BLOCK_SIZE)
+      : block_size(block_size) {}
+  arena(const arena &other) = delete;
+  arena &operator=(const arena &other) = delete;
+
+  ~arena() {
+    while (head != nullptr) {
+      block *next = head->next;
+      ::operator delete(head);
+      head = next;
+    }
+  }
+
+  void *allocate(std::size_t bytes, std::size_t alignment) {
+    if (current != nullptr) {
+      auto base = reinterpret_cast<std::uintptr_t>(current->data());
+      auto p = (base + used + alignment - 1) & ~(std::uintptr_t)(alignment - 1);
+      if (p + bytes <= base + current->capacity) {
+        used = p + bytes - base;
+        return reinterpret_cast<void *>(p);
+      }
+    }
+    next_block(bytes + alignment);
+    auto base = reinterpret_cast<std::uintptr_t>(current->data());
+    auto p = (base + alignment - 1) & ~(std::uintptr_t)(alignment - 1);
+    used = p + bytes - base;
+    return reinterpret_cast<void *>(p);
+  }
+
+  // Uninitialized storage for n objects of type T
+  template <typename T> T *allocate(std::size_t n = 1) {
+    return static_cast<T *>(allocate(sizeof(T) * n, alignof(T)));
+  }
+
+  template <typename T, typename... Args> T *make(Args &&...args) {
+    return new (allocate<T>()) T(std::forward<Args>(args)...);
+  }
+
+  void reset() {
+    current = head;
+    used = 0;
+  }
+
+  // The bytes of all the blocks of the arena, used or not
+  std::size_t get_capacity() const { return capacity; }
+};
+
+} // namespace qs
+
+#endif // QS_ARENA_HPP
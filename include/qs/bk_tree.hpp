@@ -18,9 +18,21 @@ typedef int (*distance_function)(qs::string_view, qs::string_view);
 
 template <typename T> class bk_tree;
 template <typename T> class bk_tree_node;
+template <typename T> class flat_bk_tree;
+template <typename T> class flat_trie;
+template <typename T> class deletion_index;
+template <typename T> class partition_index;
+template <typename T> class flat_scan;
+
+// A word returned by match_multi and its distance from the query
+template <typename T> struct bk_tree_match {
+  T *data;
+  int distance;
+};
 
 template <typename T> class bk_tree_node {
   friend class bk_tree<T>;
+  friend class flat_bk_tree<T>;
   using node_p = bk_tree_node<T> *;
   using node_list = skip_list<node_p, QS_BK_TREE_SKIP_LIST_LEVELS>;
 
@@ -30,6 +42,9 @@ template <typename T> class bk_tree_node {
 
   T data;
   int distance_from_parent{};
+  // A removed word. The node stays in the tree since its children were placed
+  // by their distance from it
+  bool dead = false;
   node_list children;
 
 public:
@@ -61,6 +76,8 @@ template <typename T> class bk_tree {
 
   distance_function dist_func{};
   node_p root;
+  std::size_t size = 0;
+  std::size_t dead_count = 0;
 #ifdef QS_DEBUG
 public:
 #endif
@@ -68,6 +85,11 @@ public:
 
 public:
   friend class bk_tree_node<T>;
+  friend class flat_bk_tree<T>;
+  friend class flat_trie<T>;
+  friend class deletion_index<T>;
+  friend class partition_index<T>;
+  friend class flat_scan<T>;
 
   bk_tree() = default;
   explicit bk_tree(distance_function d) : dist_func(d), root(nullptr) {}
@@ -86,22 +108,40 @@ public:
   bk_tree(bk_tree &&other) noexcept {
     this->root = std::move(other.root);
     this->dist_func = other.dist_func;
+    this->size = other.size;
+    this->dead_count = other.dead_count;
+    this->depth = other.depth;
+    other.root = nullptr;
+    other.size = 0;
+    other.dead_count = 0;
   }
   bk_tree &operator=(bk_tree &&other) noexcept {
     if (this != &other) {
       delete this->root;
       this->root = std::move(other.root);
       this->dist_func = other.dist_func;
+      this->size = other.size;
+      this->dead_count = other.dead_count;
+      this->depth = other.depth;
+      other.root = nullptr;
+      other.size = 0;
+      other.dead_count = 0;
     }
     return *this;
   }
 
   ~bk_tree() { delete this->root; }
 
+  // Every node, including the removed ones that were not compacted away yet
+  std::size_t get_size() const { return this->size; }
+  std::size_t get_dead_count() const { return this->dead_count; }
+
+  // A removed word that is inserted again takes its old node back
   void insert(T data) {
     node_p curr_node = this->root;
     if (curr_node == nullptr) {
       this->root = new bk_tree_node<T>{data};
+      this->size++;
       this->depth++;
       return;
     }
@@ -112,6 +152,13 @@ public:
       local_depth++;
       distance_from_parent = dist_func(curr_node->data.get_string_view(),
                                        new_child->data.get_string_view());
+      if (distance_from_parent == 0 && curr_node->dead) {
+        curr_node->data = std::move(new_child->data);
+        curr_node->dead = false;
+        this->dead_count--;
+        delete new_child;
+        return;
+      }
       if (curr_node->children.get_size() > 0) {
         new_child->distance_from_parent = distance_from_parent;
         auto res = curr_node->children.find(new_child);
@@ -127,6 +174,7 @@ public:
         break;
       }
     }
+    this->size++;
     if (this->depth < local_depth) {
       this->depth = local_depth;
     }
@@ -150,7 +198,7 @@ public:
       curr_node = stack.at(--curr_stack_pos);
       D = (*dist_func)(curr_node->data.get_string_view(),
                        query.get_string_view());
-      if (D <= threshold) {
+      if (D <= threshold && !curr_node->dead) {
         ret.append(&curr_node->data);
       }
       int lower_bound = D - threshold;
@@ -169,7 +217,112 @@ public:
     return ret;
   }
 
+  // One traversal for every threshold up to max_threshold. Each match is
+  // returned with its distance so it can be filtered for any smaller threshold
+  template <typename Q>
+  qs::linked_list<bk_tree_match<T>> match_multi(int max_threshold,
+                                                Q query) const {
+    qs::linked_list<bk_tree_match<T>> ret{};
+    node_p curr_node;
+    int D;
+    qs::vector<node_p> stack{this->depth * 2};
+    int curr_stack_pos = 0;
+    if (this->root == nullptr) {
+      return ret;
+    } else {
+      stack.set(curr_stack_pos++, this->root);
+    }
+
+    while (curr_stack_pos > 0) {
+      curr_node = stack.at(--curr_stack_pos);
+      D = (*dist_func)(curr_node->data.get_string_view(),
+                       query.get_string_view());
+      if (D <= max_threshold && !curr_node->dead) {
+        ret.append(bk_tree_match<T>{&curr_node->data, D});
+      }
+      int lower_bound = D - max_threshold;
+      int upper_bound = D + max_threshold;
+      for (auto child = curr_node->children.cbegin();
+           child != curr_node->children.cend(); child++) {
+        if ((*child)->distance_from_parent < lower_bound) {
+          continue;
+        } else if (child.operator*()->distance_from_parent <= upper_bound) {
+          stack.set(curr_stack_pos++, *child);
+        } else {
+          break;
+        }
+      }
+    }
+    return ret;
+  }
+
   template <typename Q> T *find(const Q what) const {
+    auto node = this->find_node(what);
+    return node != nullptr ? &node->data : nullptr;
+  }
+
+  // Marks the node of what as removed. It is skipped by match and find and
+  // dropped by the next compact(). Returns false if what is not in the tree
+  template <typename Q> bool remove(const Q &what) {
+    auto node = this->find_node(what);
+    if (node == nullptr) {
+      return false;
+    }
+    node->dead = true;
+    this->dead_count++;
+    return true;
+  }
+
+  // Calls fn with the data of every word that was not removed, in no
+  // particular order
+  template <typename Fn> void for_each(Fn fn) const {
+    if (this->root == nullptr) {
+      return;
+    }
+    qs::vector<node_p> stack{this->depth * 2 + 2};
+    stack.push(this->root);
+    while (stack.get_size() > 0) {
+      auto node = stack.pop();
+      if (!node->dead) {
+        fn(static_cast<const T &>(node->data));
+      }
+      for (auto child = node->children.cbegin(); child != node->children.cend();
+           child++) {
+        stack.push(*child);
+      }
+    }
+  }
+
+  // Rebuilds the tree from the words that were not removed
+  void compact() {
+    if (this->root == nullptr) {
+      return;
+    }
+    qs::vector<T> live{this->size - this->dead_count + 2};
+    qs::vector<node_p> stack{this->depth * 2 + 2};
+    stack.push(this->root);
+    while (stack.get_size() > 0) {
+      auto node = stack.pop();
+      if (!node->dead) {
+        live.push(std::move(node->data));
+      }
+      for (auto child = node->children.cbegin(); child != node->children.cend();
+           child++) {
+        stack.push(*child);
+      }
+    }
+    delete this->root;
+    this->root = nullptr;
+    this->size = 0;
+    this->dead_count = 0;
+    this->depth = 0;
+    for (auto &data : live) {
+      this->insert(std::move(data));
+    }
+  }
+
+private:
+  template <typename Q> node_p find_node(const Q &what) const {
     node_p curr_node;
     int D;
     qs::vector<node_p> stack{this->depth * 2};
@@ -185,7 +338,9 @@ public:
       D = (*dist_func)(curr_node->data.get_string_view(),
                        what.get_string_view());
       if (D == 0) {
-        return &curr_node->data;
+        // Inserting a removed word revives its node so there is no other
+        // node for it
+        return curr_node->dead ? nullptr : curr_node;
       }
       int lower_bound = D;
       int upper_bound = D;
@@ -203,6 +358,7 @@ public:
     return nullptr;
   }
 
+public:
 #ifdef QS_DEBUG
   bk_tree_node<T> *get_root() const { return this->root; }
 #endif
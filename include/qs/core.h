@@ -9,6 +9,15 @@
 #define QS_FORCE_INLINE inline
 #endif
 
+#define QS_CACHE_LINE_SIZE 64
+
+// Hint to the cpu that this is a spin wait loop
+#if defined(__x86_64__) || defined(__i386__)
+#define QS_CPU_RELAX() __builtin_ia32_pause()
+#else
+#define QS_CPU_RELAX() ((void)0)
+#endif
+
 typedef uint8_t byte;
 typedef uint8_t u8;
 typedef uint16_t u16;
@@ -0,0 +1,282 @@
+#ifndef QS_DELETION_INDEX_HPP
+#define QS_DELETION_INDEX_HPP
+
+#include <algorithm>
+
+#include <qs/bk_tree.hpp>
+#include <qs/core.h>
+#include <qs/distances.hpp>
+#include <qs/hash.h>
+#include <qs/hash_table.hpp>
+#include <qs/list.hpp>
+#include <qs/packed_word.h>
+#include <qs/vector.hpp>
+#include <qs/word_filter.hpp>
+
+namespace qs {
+
+// The most deletions a deletion_index generates per word
+#define QS_DELETION_INDEX_MAX_DIST 3
+
+// A frozen symmetric delete index of the words of a bk_tree for edit
+// distance searches, built and read like a flat_bk_tree. Two words are within
+// edit distance k only if deleting at most k letters from each gives the same
+// string, so every word is indexed under the hashes of all its deletion
+// variants up to the max_dist it was built for. A search looks up the
+// variants of the query and verifies the words it finds with the bounded edit
+// distance, which also rules out the words that only share a hash.
+//
+// The number of variants grows with the length of the words to the power of
+// max_dist, so the index has a size cap and the build fails instead of going
+// over it. Searches with a threshold above max_dist verify every word, and
+// for edit distances the word filters rule out most of them first.
+template <typename T> class deletion_index {
+  struct variant_range {
+    u32 begin;
+    u32 count;
+  };
+
+  struct variant_word {
+    u64 hash;
+    u32 word;
+
+    bool operator<(const variant_word &other) const {
+      return hash != other.hash ? hash < other.hash : word < other.word;
+    }
+    bool operator==(const variant_word &other) const {
+      return hash == other.hash && word == other.word;
+    }
+  };
+
+  distance_function dist_func{};
+  int max_dist = 0;
+  qs::vector<T> data;
+  // The filter of every word of data, empty unless has_word_filter(dist_func)
+  qs::vector<word_filter> filters;
+  // The words of every variant, grouped by variant
+  qs::vector<u32> words;
+  // lookup() does not modify the table, it is only not marked const
+  mutable qs::hash_table<u64, variant_range> variants{1};
+  std::size_t memory = 0;
+
+  // Calls fn with the hash of every string left after deleting up to
+  // deletions letters of word. A string reached more than once is passed
+  // more than once
+  template <typename Fn>
+  static void for_each_variant(qs::string_view word, int deletions, Fn fn) {
+    char variant[QS_PACKED_WORD_SIZE];
+    int length = (int)word.size();
+    // The deleted positions, in increasing order
+    int deleted[QS_DELETION_INDEX_MAX_DIST + 1];
+    fn(qs::hash_bytes(word.data(), word.size()));
+    for (int k = 1; k <= deletions && k <= length; k++) {
+      for (int i = 0; i < k; i++) {
+        deleted[i] = i;
+      }
+      while (true) {
+        int out = 0;
+        for (int c = 0, next = 0; c < length; c++) {
+          if (next < k && deleted[next] == c) {
+            next++;
+          } else {
+            variant[out++] = word.data()[c];
+          }
+        }
+        fn(qs::hash_bytes(variant, (std::size_t)out));
+        // The next combination of k positions
+        int i = k - 1;
+        while (i >= 0 && deleted[i] == length - k + i) {
+          i--;
+        }
+        if (i < 0) {
+          break;
+        }
+        deleted[i]++;
+        for (int j = i + 1; j < k; j++) {
+          deleted[j] = deleted[j - 1] + 1;
+        }
+      }
+    }
+  }
+
+public:
+  deletion_index() = default;
+
+  deletion_index(const deletion_index &other) = delete;
+  deletion_index &operator=(const deletion_index &other) = delete;
+  deletion_index(deletion_index &&other) noexcept = default;
+  deletion_index &operator=(deletion_index &&other) noexcept = default;
+
+  // Throws away the current index and builds it from the words of tree that
+  // were not removed, with the data of every word produced by copy_data.
+  // Returns false and leaves the index empty if the variants of the words
+  // would take more than max_bytes
+  template <typename Fn>
+  bool rebuild(const bk_tree<T> &tree, int max_dist, std::size_t max_bytes,
+               Fn copy_data) {
+    if (max_dist > QS_DELETION_INDEX_MAX_DIST) {
+      throw std::runtime_error("too many deletions for a deletion_index");
+    }
+    std::size_t size = tree.get_size() > 0 ? tree.get_size() : 1;
+    this->dist_func = tree.dist_func;
+    this->max_dist = max_dist;
+    this->data = qs::vector<T>{size + 1};
+    this->filters = qs::vector<word_filter>{1};
+    this->words = qs::vector<u32>{1};
+    this->variants = qs::hash_table<u64, variant_range>{1};
+    this->memory = 0;
+
+    bool fits = true;
+    qs::vector<variant_word> pairs{size * 8 + 1};
+    tree.for_each([&](const T &d) {
+      if (!fits) {
+        return;
+      }
+      auto word = d.get_string_view();
+      if (word.size() >= QS_PACKED_WORD_SIZE) {
+        throw std::runtime_error("word does not fit in a deletion_index");
+      }
+      u32 index = (u32)this->data.get_size();
+      for_each_variant(word, max_dist, [&pairs, index](u64 hash) {
+        pairs.push(variant_word{hash, index});
+      });
+      this->data.push(copy_data(d));
+      if (pairs.get_size() * sizeof(variant_word) > max_bytes) {
+        fits = false;
+      }
+    });
+    if (!fits) {
+      this->data = qs::vector<T>{1};
+      return false;
+    }
+    if (has_word_filter(this->dist_func)) {
+      this->filters = qs::vector<word_filter>{this->data.get_size() + 1};
+      for (auto &d : this->data) {
+        this->filters.push(word_filter{d.get_string_view()});
+      }
+    }
+
+    auto pairs_p = pairs.get_data();
+    std::size_t count = pairs.get_size();
+    std::sort(pairs_p, pairs_p + count);
+    count = std::unique(pairs_p, pairs_p + count) - pairs_p;
+
+    std::size_t distinct = 0;
+    for (std::size_t i = 0; i < count; i++) {
+      distinct += i == 0 || pairs_p[i].hash != pairs_p[i - 1].hash;
+    }
+    this->words = qs::vector<u32>{count + 1};
+    this->variants = qs::hash_table<u64, variant_range>{distinct * 2 + 1};
+    for (std::size_t i = 0; i < count;) {
+      std::size_t j = i;
+      while (j < count && pairs_p[j].hash == pairs_p[i].hash) {
+        this->words.push(pairs_p[j++].word);
+      }
+      this->variants.insert(pairs_p[i].hash,
+                            variant_range{(u32)i, (u32)(j - i)});
+      i = j;
+    }
+    this->memory = this->data.get_size() * sizeof(T) +
+                   this->filters.get_size() * sizeof(word_filter) +
+                   this->words.get_size() * sizeof(u32) +
+                   this->variants.get_memory();
+    return true;
+  }
+
+  // The number of words
+  std::size_t get_size() const { return this->data.get_size(); }
+  distance_function get_distance_function() const { return this->dist_func; }
+  int get_max_dist() const { return this->max_dist; }
+  // The bytes taken by the words and their variants
+  std::size_t get_memory() const { return this->memory; }
+
+  const T *begin() const { return this->data.get_data(); }
+  const T *end() const { return this->data.get_data() + this->data.get_size(); }
+
+  template <typename Q>
+  qs::linked_list<T *> match(int threshold, const Q &query) const {
+    qs::linked_list<T *> ret{};
+    this->traverse(threshold, query,
+                   [&ret](T *data, int) { ret.append(data); });
+    return ret;
+  }
+
+  // Calls on_match with the data and the edit distance of every word within
+  // threshold of query. Returns the number of candidates verified and adds
+  // the candidates checked against their word filter to stats
+  template <typename Q, typename Fn>
+  std::size_t traverse(int threshold, const Q &query, Fn on_match,
+                       filter_stats *stats = nullptr) const {
+    auto q = query.get_string_view();
+    if (q.size() >= QS_PACKED_WORD_SIZE) {
+      throw std::runtime_error("word does not fit in a deletion_index");
+    }
+    auto data_p = this->data.get_data();
+    std::size_t size = this->data.get_size();
+    auto filters_p = this->filters.get_data();
+    bool filtered = this->filters.get_size() > 0;
+    word_filter query_filter = filtered ? word_filter{q} : word_filter{};
+    std::size_t verified = 0;
+    filter_stats unused{};
+    auto checks = stats != nullptr ? stats : &unused;
+    auto verify = [&](u32 index) {
+      auto word = data_p[index].get_string_view();
+      int length_diff = (int)word.size() - (int)q.size();
+      if (length_diff > threshold || -length_diff > threshold) {
+        return;
+      }
+      if (filtered) {
+        checks->checked++;
+        if (query_filter.lower_bound(filters_p[index]) > threshold) {
+          checks->rejected++;
+          return;
+        }
+      }
+      int d = qs::bounded_edit_distance(word, q, threshold);
+      verified++;
+      if (d <= threshold) {
+        on_match(&data_p[index], d);
+      }
+    };
+    if (threshold > this->max_dist) {
+      for (u32 i = 0; i < size; i++) {
+        verify(i);
+      }
+      return verified;
+    }
+
+    // A word is verified once even if it shares many variants with the
+    // query. The stamps are only compared against the current search
+    static thread_local qs::vector<u32> stamps{64};
+    static thread_local u32 stamp = 0;
+    while (stamps.get_size() < size) {
+      stamps.push(0);
+    }
+    if (++stamp == 0) {
+      for (auto &s : stamps) {
+        s = 0;
+      }
+      stamp = 1;
+    }
+    auto stamps_p = stamps.get_data();
+    auto words_p = this->words.get_data();
+    for_each_variant(q, threshold, [&](u64 hash) {
+      auto range = this->variants.lookup(hash);
+      if (range == this->variants.end()) {
+        return;
+      }
+      for (u32 i = range->begin; i != range->begin + range->count; i++) {
+        u32 index = words_p[i];
+        if (stamps_p[index] != stamp) {
+          stamps_p[index] = stamp;
+          verify(index);
+        }
+      }
+    });
+    return verified;
+  }
+};
+
+} // namespace qs
+
+#endif // QS_DELETION_INDEX_HPP
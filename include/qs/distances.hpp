@@ -3,6 +3,7 @@
 
 #include <limits>
 #include <qs/functions/ops.hpp>
+#include <qs/packed_word.h>
 #include <qs/string_view.h>
 
 namespace qs {
@@ -10,6 +11,32 @@ namespace qs {
 int hamming_distance(qs::string_view s1, qs::string_view s2);
 int edit_distance(qs::string_view s1, qs::string_view s2);
 
+// Hamming distance of two packed words of the same length computed with one
+// vector compare and a popcount. The kernel (AVX2, SSE4.2 or scalar) is picked
+// at runtime using CPUID.
+int packed_hamming_distance(const packed_word &w1, const packed_word &w2);
+
+// Same as above for views obtained from packed_word::get_string_view. The
+// views MUST point to the start of a packed_word slot since the whole slot is
+// read. Can be used anywhere a qs::distance_function is expected.
+int packed_hamming_distance(qs::string_view s1, qs::string_view s2);
+
+// Scores w against each of the n packed words and stores the distances to out
+void packed_hamming_distance_batch(const packed_word &w,
+                                   const packed_word *words, std::size_t n,
+                                   int *out);
+
+// Same result as edit_distance but computed with a bit-vector algorithm.
+// Can be used anywhere a qs::distance_function is expected.
+int bit_parallel_edit_distance(qs::string_view s1, qs::string_view s2);
+
+// Returns the edit distance of s1 and s2 if it is at most max_dist, or
+// max_dist + 1 otherwise. It stops as soon as the bound is exceeded so it
+// must not be used where the exact distance is needed (e.g. bk_tree
+// insertion).
+int bounded_edit_distance(qs::string_view s1, qs::string_view s2,
+                          int max_dist);
+
 } // namespace qs
 
 #endif // QS_DISTANCES_HPP
@@ -2,11 +2,14 @@
 #define QS_ENTRY_HPP
 #include <qs/bk_tree.hpp>
 #include <qs/distances.hpp>
+#include <qs/packed_word.h>
 #include <qs/string.h>
 #include <qs/string_view.h>
 
 namespace qs {
 template <typename T> struct entry {
+  using key_type = qs::string_view;
+
   qs::string_view word;
   T payload;
   explicit entry(qs::string_view w) : word(w), payload(T{}) {}
@@ -16,6 +19,39 @@ template <typename T> struct entry {
   string_view get_string_view() const { return this->word; }
 };
 
+// An entry that keeps its own copy of the word in a packed_word slot so it can
+// be used with the packed distance kernels
+template <typename T> struct packed_entry {
+  using key_type = qs::packed_word;
+
+  qs::packed_word word;
+  T payload;
+  explicit packed_entry(const qs::packed_word &w) : word(w), payload(T{}) {}
+  packed_entry(const qs::packed_word &w, const T &p) : word(w), payload(p) {}
+  packed_entry(const qs::packed_word &w, T &&p)
+      : word(w), payload(std::move(p)) {}
+
+  string_view get_string_view() const { return this->word.get_string_view(); }
+};
+
+// An entry for a word that lives in a word_dictionary. It keeps the ID of the
+// word and a pointer to its slot instead of a copy of the bytes. K is the type
+// the words that are matched against the entry are turned into
+template <typename T, typename K = qs::string_view> struct word_entry {
+  using key_type = K;
+
+  u32 id;
+  const qs::packed_word *word;
+  T payload;
+  word_entry(u32 id, const qs::packed_word *w) : id(id), word(w), payload(T{}) {}
+  word_entry(u32 id, const qs::packed_word *w, const T &p)
+      : id(id), word(w), payload(p) {}
+  word_entry(u32 id, const qs::packed_word *w, T &&p)
+      : id(id), word(w), payload(std::move(p)) {}
+
+  string_view get_string_view() const { return this->word->get_string_view(); }
+};
+
 } // namespace qs
 
 #endif // QS_ENTRY_HPP
@@ -0,0 +1,223 @@
+#ifndef QS_FLAT_BK_TREE_HPP
+#define QS_FLAT_BK_TREE_HPP
+
+#include <qs/bk_tree.hpp>
+#include <qs/core.h>
+#include <qs/list.hpp>
+#include <qs/packed_word.h>
+#include <qs/vector.hpp>
+#include <qs/word_filter.hpp>
+
+namespace qs {
+
+// A frozen, cache friendly copy of a bk_tree. The nodes are laid out in one
+// array in DFS order, the children of each node are a contiguous range of
+// (distance, index) pairs sorted by distance and the words are stored inline
+// in packed_word slots so match() does not chase any pointers.
+//
+// The flat tree owns a copy of the data of the bk_tree it was built from so it
+// is immutable and can be read while the source tree keeps changing. New
+// insertions to the source tree are not visible until the flat tree is
+// rebuilt.
+//
+// For edit distances the word filter of every node is kept as well. A node
+// whose filter already puts it and all of its children out of range is
+// skipped without computing its distance.
+template <typename T> class flat_bk_tree {
+  struct flat_node {
+    u32 children_begin;
+    u32 children_end;
+    // Removed from the source tree, only kept for its children
+    bool dead;
+  };
+
+  struct flat_child {
+    int distance;
+    u32 index;
+  };
+
+  distance_function dist_func{};
+  qs::vector<flat_node> nodes;
+  qs::vector<flat_child> children;
+  qs::vector<packed_word> words;
+  // Empty unless has_word_filter(dist_func)
+  qs::vector<word_filter> filters;
+  qs::vector<T> data;
+  std::size_t depth = 0;
+
+  struct build_frame {
+    bk_tree_node<T> *node;
+    std::size_t depth;
+    // The slot in the children array of the parent that points to this node
+    u32 parent_slot;
+  };
+
+  // Iterative pre-order traversal of the source tree. The children range of
+  // a node is reserved when the node is visited and each slot is filled in
+  // once the child itself gets its index.
+  template <typename Fn>
+  void append_tree(bk_tree_node<T> *root, Fn copy_data) {
+    qs::vector<build_frame> stack{this->nodes.get_size() + 2};
+    std::size_t curr_stack_pos = 0;
+    stack.set(curr_stack_pos++, build_frame{root, 1, 0});
+    while (curr_stack_pos > 0) {
+      auto frame = stack[--curr_stack_pos];
+      auto node = frame.node;
+      u32 index = (u32)this->nodes.get_size();
+      if (node != root) {
+        this->children[frame.parent_slot].index = index;
+      }
+      if (this->depth < frame.depth) {
+        this->depth = frame.depth;
+      }
+
+      u32 begin = (u32)this->children.get_size();
+      for (auto child : node->children) {
+        this->children.push(flat_child{child->distance_from_parent, 0});
+      }
+      u32 end = (u32)this->children.get_size();
+      this->nodes.push(flat_node{begin, end, node->dead});
+      this->words.push(packed_word{node->data.get_string_view()});
+      if (has_word_filter(this->dist_func)) {
+        this->filters.push(word_filter{node->data.get_string_view()});
+      }
+      this->data.push(copy_data(node->data));
+
+      // The last child is visited first but every subtree still ends up
+      // contiguous right after its root
+      u32 slot = begin;
+      for (auto child : node->children) {
+        stack.set(curr_stack_pos++, build_frame{child, frame.depth + 1, slot++});
+      }
+    }
+  }
+
+public:
+  flat_bk_tree() = default;
+  explicit flat_bk_tree(const bk_tree<T> &tree) { this->rebuild(tree); }
+
+  flat_bk_tree(const flat_bk_tree &other) = delete;
+  flat_bk_tree &operator=(const flat_bk_tree &other) = delete;
+  flat_bk_tree(flat_bk_tree &&other) noexcept = default;
+  flat_bk_tree &operator=(flat_bk_tree &&other) noexcept = default;
+
+  // Throws away the current layout and copies the structure and the data of
+  // tree
+  void rebuild(const bk_tree<T> &tree) {
+    this->rebuild(tree, [](const T &d) { return d; });
+  }
+
+  // Same as above but the data of every node is produced by copy_data, e.g.
+  // to drop parts of the payload that must not be visible to readers
+  template <typename Fn> void rebuild(const bk_tree<T> &tree, Fn copy_data) {
+    std::size_t size = tree.get_size() > 0 ? tree.get_size() : 1;
+    this->dist_func = tree.dist_func;
+    this->nodes = qs::vector<flat_node>{size + 1};
+    this->children = qs::vector<flat_child>{size + 1};
+    this->words = qs::vector<packed_word>{size + 1};
+    this->filters = qs::vector<word_filter>{
+        has_word_filter(this->dist_func) ? size + 1 : 1};
+    this->data = qs::vector<T>{size + 1};
+    this->depth = 0;
+    if (tree.root != nullptr) {
+      append_tree(tree.root, copy_data);
+    }
+  }
+
+  std::size_t get_size() const { return this->nodes.get_size(); }
+  distance_function get_distance_function() const { return this->dist_func; }
+
+  // The data of every node, in no particular order. Removed words are
+  // included
+  const T *begin() const { return this->data.get_data(); }
+  const T *end() const { return this->data.get_data() + this->data.get_size(); }
+
+  template <typename Q>
+  qs::linked_list<T *> match(int threshold, const Q &query) const {
+    qs::linked_list<T *> ret{};
+    this->traverse(threshold, query,
+                   [&ret](T *data, int) { ret.append(data); });
+    return ret;
+  }
+
+  // One traversal for every threshold up to max_threshold, see
+  // bk_tree::match_multi
+  template <typename Q>
+  qs::linked_list<bk_tree_match<T>> match_multi(int max_threshold,
+                                                const Q &query) const {
+    qs::linked_list<bk_tree_match<T>> ret{};
+    this->traverse(max_threshold, query, [&ret](T *data, int distance) {
+      ret.append(bk_tree_match<T>{data, distance});
+    });
+    return ret;
+  }
+
+  // Calls on_match with the data and the distance of every word within
+  // threshold of query. Returns the number of distances computed and adds
+  // the nodes checked against their word filter to stats
+  template <typename Q, typename Fn>
+  std::size_t traverse(int threshold, const Q &query, Fn on_match,
+                       filter_stats *stats = nullptr) const {
+    if (this->nodes.get_size() == 0) {
+      return 0;
+    }
+    auto query_view = query.get_string_view();
+    auto nodes_p = this->nodes.get_data();
+    auto children_p = this->children.get_data();
+    auto words_p = this->words.get_data();
+    auto data_p = this->data.get_data();
+    auto filters_p = this->filters.get_data();
+    bool filtered = this->filters.get_size() > 0;
+    word_filter query_filter =
+        filtered ? word_filter{query_view} : word_filter{};
+    std::size_t rejected = 0;
+
+    qs::vector<u32> stack{this->depth * 2};
+    std::size_t curr_stack_pos = 0;
+    stack.set(curr_stack_pos++, 0);
+    std::size_t visited = 0;
+
+    while (curr_stack_pos > 0) {
+      u32 curr = stack[--curr_stack_pos];
+      auto &node = nodes_p[curr];
+      if (filtered) {
+        // The distance is at least bound, so the children that can be in
+        // range are at least bound - threshold from the node. They are
+        // sorted, the last one is the farthest
+        int bound = query_filter.lower_bound(filters_p[curr]);
+        if (bound > threshold &&
+            (node.children_begin == node.children_end ||
+             children_p[node.children_end - 1].distance < bound - threshold)) {
+          rejected++;
+          continue;
+        }
+      }
+      int D = (*dist_func)(words_p[curr].get_string_view(), query_view);
+      visited++;
+      if (D <= threshold && !node.dead) {
+        on_match(&data_p[curr], D);
+      }
+      int lower_bound = D - threshold;
+      int upper_bound = D + threshold;
+      for (u32 c = node.children_begin; c != node.children_end; c++) {
+        auto &child = children_p[c];
+        if (child.distance < lower_bound) {
+          continue;
+        } else if (child.distance <= upper_bound) {
+          stack.set(curr_stack_pos++, child.index);
+        } else {
+          break;
+        }
+      }
+    }
+    if (stats != nullptr && filtered) {
+      stats->checked += visited + rejected;
+      stats->rejected += rejected;
+    }
+    return visited;
+  }
+};
+
+} // namespace qs
+
+#endif // QS_FLAT_BK_TREE_HPP
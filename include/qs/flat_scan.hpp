@@ -0,0 +1,134 @@
+#ifndef QS_FLAT_SCAN_HPP
+#define QS_FLAT_SCAN_HPP
+
+#include <qs/bk_tree.hpp>
+#include <qs/core.h>
+#include <qs/distances.hpp>
+#include <qs/list.hpp>
+#include <qs/packed_word.h>
+#include <qs/vector.hpp>
+#include <qs/word_filter.hpp>
+
+namespace qs {
+
+// Words scored by one call of the batch hamming kernel
+#define QS_FLAT_SCAN_BATCH 64
+
+// A frozen copy of the words of a bk_tree that is searched by scoring every
+// word, built and read like a flat_bk_tree. The words are one contiguous
+// array of packed_word slots next to the array of their data, so hamming
+// distances go through packed_hamming_distance_batch and a search costs the
+// same for every query. On small indices that beats following a tree.
+//
+// Other distances are computed one word at a time, after the word filter
+// for edit distances.
+template <typename T> class flat_scan {
+  distance_function dist_func{};
+  bool hamming = false;
+  qs::vector<packed_word> words;
+  // Empty unless has_word_filter(dist_func)
+  qs::vector<word_filter> filters;
+  qs::vector<T> data;
+
+public:
+  flat_scan() = default;
+  explicit flat_scan(const bk_tree<T> &tree) { this->rebuild(tree); }
+
+  flat_scan(const flat_scan &other) = delete;
+  flat_scan &operator=(const flat_scan &other) = delete;
+  flat_scan(flat_scan &&other) noexcept = default;
+  flat_scan &operator=(flat_scan &&other) noexcept = default;
+
+  void rebuild(const bk_tree<T> &tree) {
+    this->rebuild(tree, [](const T &d) { return d; });
+  }
+
+  // Throws away the current words and copies the words of tree that were not
+  // removed, with the data of every word produced by copy_data
+  template <typename Fn> void rebuild(const bk_tree<T> &tree, Fn copy_data) {
+    std::size_t size = tree.get_size() > 0 ? tree.get_size() : 1;
+    this->dist_func = tree.dist_func;
+    // Both agree with the batch kernel on words of the same length
+    this->hamming =
+        tree.dist_func == &hamming_distance ||
+        tree.dist_func ==
+            static_cast<distance_function>(&packed_hamming_distance);
+    bool filtered = has_word_filter(tree.dist_func);
+    this->words = qs::vector<packed_word>{size + 1};
+    this->filters = qs::vector<word_filter>{filtered ? size + 1 : 1};
+    this->data = qs::vector<T>{size + 1};
+    tree.for_each([this, &copy_data, filtered](const T &d) {
+      this->words.push(packed_word{d.get_string_view()});
+      if (filtered) {
+        this->filters.push(word_filter{d.get_string_view()});
+      }
+      this->data.push(copy_data(d));
+    });
+  }
+
+  // The number of words
+  std::size_t get_size() const { return this->data.get_size(); }
+  distance_function get_distance_function() const { return this->dist_func; }
+
+  const T *begin() const { return this->data.get_data(); }
+  const T *end() const { return this->data.get_data() + this->data.get_size(); }
+
+  template <typename Q>
+  qs::linked_list<T *> match(int threshold, const Q &query) const {
+    qs::linked_list<T *> ret{};
+    this->traverse(threshold, query,
+                   [&ret](T *data, int) { ret.append(data); });
+    return ret;
+  }
+
+  // Calls on_match with the data and the distance of every word within
+  // threshold of query. Returns the number of distances computed and adds
+  // the words checked against their word filter to stats
+  template <typename Q, typename Fn>
+  std::size_t traverse(int threshold, const Q &query, Fn on_match,
+                       filter_stats *stats = nullptr) const {
+    auto q = query.get_string_view();
+    auto words_p = this->words.get_data();
+    auto data_p = this->data.get_data();
+    std::size_t size = this->data.get_size();
+    if (this->hamming) {
+      packed_word packed{q};
+      int distances[QS_FLAT_SCAN_BATCH];
+      for (std::size_t i = 0; i < size; i += QS_FLAT_SCAN_BATCH) {
+        std::size_t n = size - i < QS_FLAT_SCAN_BATCH ? size - i
+                                                      : QS_FLAT_SCAN_BATCH;
+        packed_hamming_distance_batch(packed, words_p + i, n, distances);
+        for (std::size_t j = 0; j < n; j++) {
+          if (distances[j] <= threshold && words_p[i + j].size() == q.size()) {
+            on_match(&data_p[i + j], distances[j]);
+          }
+        }
+      }
+      return size;
+    }
+
+    auto filters_p = this->filters.get_data();
+    bool filtered = this->filters.get_size() > 0;
+    word_filter query_filter = filtered ? word_filter{q} : word_filter{};
+    std::size_t computed = 0;
+    for (std::size_t i = 0; i < size; i++) {
+      if (filtered && query_filter.lower_bound(filters_p[i]) > threshold) {
+        continue;
+      }
+      int d = (*this->dist_func)(words_p[i].get_string_view(), q);
+      computed++;
+      if (d <= threshold) {
+        on_match(&data_p[i], d);
+      }
+    }
+    if (stats != nullptr && filtered) {
+      stats->checked += size;
+      stats->rejected += size - computed;
+    }
+    return computed;
+  }
+};
+
+} // namespace qs
+
+#endif // QS_FLAT_SCAN_HPP
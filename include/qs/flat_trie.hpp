@@ -0,0 +1,212 @@
+#ifndef QS_FLAT_TRIE_HPP
+#define QS_FLAT_TRIE_HPP
+
+#include <algorithm>
+
+#include <qs/bk_tree.hpp>
+#include <qs/core.h>
+#include <qs/distances.hpp>
+#include <qs/list.hpp>
+#include <qs/packed_word.h>
+#include <qs/vector.hpp>
+
+namespace qs {
+
+// Marks the nodes of a flat_trie where no word ends
+#define QS_TRIE_NO_WORD 0xffffffffu
+
+// A frozen trie of the words of a bk_tree for edit distance searches, built
+// and read like a flat_bk_tree. The nodes are laid out in one array in
+// pre-order so a subtree is the range from its root to subtree_end, and the
+// search walks the array with one row of the edit distance matrix per depth
+// instead of a stack.
+//
+// Words share the rows of their common prefix, a row only computes the cells
+// that can be within the threshold and a whole subtree is skipped as soon as
+// the smallest value of a row is above the threshold, or the lengths of its
+// words are too far from the length of the query. Every word
+// must fit in a packed_word.
+template <typename T> class flat_trie {
+  struct trie_node {
+    char label;
+    u8 depth;
+    // The shortest and the longest word of the subtree
+    u8 min_length;
+    u8 max_length;
+    u32 subtree_end;
+    // The index of the word that ends here in data
+    u32 word;
+  };
+
+  distance_function dist_func{};
+  qs::vector<trie_node> nodes;
+  qs::vector<T> data;
+
+public:
+  flat_trie() = default;
+  explicit flat_trie(const bk_tree<T> &tree) { this->rebuild(tree); }
+
+  flat_trie(const flat_trie &other) = delete;
+  flat_trie &operator=(const flat_trie &other) = delete;
+  flat_trie(flat_trie &&other) noexcept = default;
+  flat_trie &operator=(flat_trie &&other) noexcept = default;
+
+  void rebuild(const bk_tree<T> &tree) {
+    this->rebuild(tree, [](const T &d) { return d; });
+  }
+
+  // Throws away the current trie and builds it from the words of tree that
+  // were not removed, with the data of every word produced by copy_data
+  template <typename Fn> void rebuild(const bk_tree<T> &tree, Fn copy_data) {
+    std::size_t size = tree.get_size() > 0 ? tree.get_size() : 1;
+    this->dist_func = tree.dist_func;
+    this->data = qs::vector<T>{size + 1};
+    tree.for_each([this, &copy_data](const T &d) {
+      this->data.push(copy_data(d));
+    });
+
+    // In sorted order every word only adds the nodes past the prefix it
+    // shares with the previous one, which is the pre-order of the trie
+    std::size_t words = this->data.get_size();
+    qs::vector<u32> order{words + 1};
+    for (u32 i = 0; i < words; i++) {
+      order.push(i);
+    }
+    auto data_p = this->data.get_data();
+    auto order_p = order.get_data();
+    std::sort(order_p, order_p + words, [data_p](u32 a, u32 b) {
+      auto wa = data_p[a].get_string_view();
+      auto wb = data_p[b].get_string_view();
+      int cmp = std::memcmp(wa.data(), wb.data(),
+                            std::min(wa.size(), wb.size()));
+      return cmp != 0 ? cmp < 0 : wa.size() < wb.size();
+    });
+
+    this->nodes = qs::vector<trie_node>{size * 4 + 1};
+    // The node of every depth on the path of the previous word
+    u32 path[QS_PACKED_WORD_SIZE + 1];
+    std::size_t path_length = 0;
+    qs::string_view previous{};
+    for (std::size_t i = 0; i < words; i++) {
+      auto word = data_p[order_p[i]].get_string_view();
+      if (word.size() == 0 || word.size() >= QS_PACKED_WORD_SIZE) {
+        throw std::runtime_error("word does not fit in a flat_trie");
+      }
+      std::size_t shared = 0;
+      while (shared < previous.size() && shared < word.size() &&
+             previous.data()[shared] == word.data()[shared]) {
+        shared++;
+      }
+      auto nodes_p = this->nodes.get_data();
+      while (path_length > shared) {
+        nodes_p[path[--path_length]].subtree_end =
+            (u32)this->nodes.get_size();
+      }
+      for (std::size_t d = shared; d < word.size(); d++) {
+        path[path_length++] = (u32)this->nodes.get_size();
+        this->nodes.push(trie_node{word.data()[d], (u8)(d + 1),
+                                   (u8)word.size(), (u8)word.size(), 0,
+                                   QS_TRIE_NO_WORD});
+      }
+      nodes_p = this->nodes.get_data();
+      nodes_p[path[path_length - 1]].word = order_p[i];
+      for (std::size_t d = 0; d < path_length; d++) {
+        auto &node = nodes_p[path[d]];
+        node.min_length = std::min(node.min_length, (u8)word.size());
+        node.max_length = std::max(node.max_length, (u8)word.size());
+      }
+      previous = word;
+    }
+    auto nodes_p = this->nodes.get_data();
+    while (path_length > 0) {
+      nodes_p[path[--path_length]].subtree_end = (u32)this->nodes.get_size();
+    }
+  }
+
+  // The number of words
+  std::size_t get_size() const { return this->data.get_size(); }
+  distance_function get_distance_function() const { return this->dist_func; }
+
+  const T *begin() const { return this->data.get_data(); }
+  const T *end() const { return this->data.get_data() + this->data.get_size(); }
+
+  template <typename Q>
+  qs::linked_list<T *> match(int threshold, const Q &query) const {
+    qs::linked_list<T *> ret{};
+    this->traverse(threshold, query,
+                   [&ret](T *data, int) { ret.append(data); });
+    return ret;
+  }
+
+  // Calls on_match with the data and the edit distance of every word within
+  // threshold of query. Returns the number of rows computed, one per node
+  // visited
+  template <typename Q, typename Fn>
+  std::size_t traverse(int threshold, const Q &query, Fn on_match) const {
+    auto q = query.get_string_view();
+    int m = (int)q.size();
+    if (m >= QS_PACKED_WORD_SIZE) {
+      throw std::runtime_error("word does not fit in a flat_trie");
+    }
+    auto qp = q.data();
+    auto nodes_p = this->nodes.get_data();
+    auto data_p = this->data.get_data();
+    std::size_t size = this->nodes.get_size();
+
+    // rows[d][j] is the edit distance of the first d letters of the node
+    // path and the first j letters of query, capped at threshold + 1. Only
+    // the band of cells with |d - j| <= threshold can be within threshold,
+    // the cells right outside of it are set to the cap
+    u8 rows[QS_PACKED_WORD_SIZE + 1][QS_PACKED_WORD_SIZE + 1];
+    const int cap = threshold + 1;
+    for (int j = 0; j <= m; j++) {
+      rows[0][j] = (u8)std::min(j, cap);
+    }
+    std::size_t visited = 0;
+    std::size_t i = 0;
+    while (i < size) {
+      auto &node = nodes_p[i];
+      if ((int)node.min_length > m + threshold ||
+          (int)node.max_length < m - threshold) {
+        i = node.subtree_end;
+        continue;
+      }
+      int d = node.depth;
+      int lo = std::max(1, d - threshold);
+      int hi = std::min(m, d + threshold);
+      const u8 *above = rows[d - 1];
+      u8 *row = rows[d];
+      row[0] = (u8)std::min(d, cap);
+      row[lo - 1] = lo > 1 ? (u8)cap : row[0];
+      int row_min = row[0];
+      for (int j = lo; j <= hi; j++) {
+        int sub = above[j - 1] + (qp[j - 1] != node.label);
+        int del = above[j] + 1;
+        int ins = row[j - 1] + 1;
+        int dist = std::min(cap, std::min(sub, std::min(del, ins)));
+        row[j] = (u8)dist;
+        row_min = std::min(row_min, dist);
+      }
+      if (hi < m) {
+        row[hi + 1] = (u8)cap;
+      }
+      visited++;
+      if (row_min > threshold) {
+        i = node.subtree_end;
+        continue;
+      }
+      if (node.word != QS_TRIE_NO_WORD) {
+        int dist = m == 0 ? d : lo <= m && m <= hi ? row[m] : cap;
+        if (dist <= threshold) {
+          on_match(&data_p[node.word], dist);
+        }
+      }
+      i++;
+    }
+    return visited;
+  }
+};
+
+} // namespace qs
+
+#endif // QS_FLAT_TRIE_HPP
@@ -1,7 +1,9 @@
 #ifndef QS_HASH_H
 #define QS_HASH_H
 
+#include <cstddef>
 #include <cstdint>
+#include <cstring>
 
 namespace qs {
 uint64_t hash_i(const uint8_t *el, int i);
@@ -9,5 +11,71 @@ uint64_t hash_i(const uint8_t *el, int i);
 uint64_t djb2(const uint8_t *str);
 uint64_t sdbm(const uint8_t *str);
 
+namespace hash_detail {
+constexpr uint64_t k0 = 0x9e3779b97f4a7c15ull;
+constexpr uint64_t k1 = 0xbf58476d1ce4e5b9ull;
+constexpr uint64_t k2 = 0x94d049bb133111ebull;
+
+inline uint64_t load64(const char *p) {
+  uint64_t v;
+  std::memcpy(&v, p, 8);
+  return v;
+}
+
+inline uint64_t load32(const char *p) {
+  uint32_t v;
+  std::memcpy(&v, p, 4);
+  return v;
+}
+
+inline uint64_t mix(uint64_t h, uint64_t v) {
+  h ^= v * k1;
+  return ((h << 31) | (h >> 33)) * k0;
+}
+
+inline uint64_t finish(uint64_t h) {
+  h ^= h >> 30;
+  h *= k1;
+  h ^= h >> 27;
+  h *= k2;
+  return h ^ (h >> 31);
+}
+} // namespace hash_detail
+
+// Hashes len bytes without reading past them. The words of the documents are
+// short so the common lengths take a fixed number of overlapping unaligned
+// loads instead of a loop over the bytes: two for up to 16 bytes and four up
+// to 32
+inline uint64_t hash_bytes(const char *data, std::size_t len) {
+  using namespace hash_detail;
+  uint64_t h = k0 ^ (len * k2);
+  if (len <= 16) {
+    uint64_t a = 0;
+    uint64_t b = 0;
+    if (len >= 8) {
+      a = load64(data);
+      b = load64(data + len - 8);
+    } else if (len >= 4) {
+      a = load32(data);
+      b = load32(data + len - 4);
+    } else if (len > 0) {
+      // The first, middle and last bytes are every byte of the word
+      a = (uint64_t)(uint8_t)data[0] | (uint64_t)(uint8_t)data[len / 2] << 8 |
+          (uint64_t)(uint8_t)data[len - 1] << 16;
+    }
+    return finish(mix(mix(h, a), b));
+  }
+  if (len <= 32) {
+    h = mix(mix(h, load64(data)), load64(data + 8));
+    h = mix(mix(h, load64(data + len - 16)), load64(data + len - 8));
+    return finish(h);
+  }
+  std::size_t i = 0;
+  for (; i + 8 < len; i += 8) {
+    h = mix(h, load64(data + i));
+  }
+  return finish(mix(h, load64(data + len - 8)));
+}
+
 } // namespace qs
 #endif
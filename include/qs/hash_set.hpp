@@ -12,6 +12,7 @@ template <class K, class Hash = std::hash<K>> class hash_set {
 public:
   hash_set() = default;
   explicit hash_set(std::size_t capacity) : table{capacity} {};
+  hash_set(std::size_t capacity, arena *alloc) : table{capacity, alloc} {};
   hash_set(const hash_set &other) = delete;
   hash_set(hash_set &&other) noexcept : table{std::move(other.table)} {}
 
@@ -10,6 +10,7 @@
 #include <type_traits>
 #include <utility>
 
+#include <qs/arena.hpp>
 #include <qs/core.h>
 #include <qs/hash.h>
 #include <qs/list.hpp>
@@ -64,6 +65,29 @@ class hash_table {
   std::size_t capacity;
   key_pair *keys;
   ValueStorage *values;
+  // Where the slot arrays come from. nullptr means the heap
+  arena *alloc = nullptr;
+
+  key_pair *allocate_keys(std::size_t n) {
+    if (alloc == nullptr) {
+      return new key_pair[n];
+    }
+    auto slots = alloc->allocate<key_pair>(n);
+    for (std::size_t i = 0; i < n; ++i) {
+      new (&slots[i]) key_pair();
+    }
+    return slots;
+  }
+  ValueStorage *allocate_values(std::size_t n) {
+    return alloc != nullptr ? alloc->allocate<ValueStorage>(n)
+                            : new ValueStorage[n];
+  }
+  void deallocate(key_pair *old_keys, ValueStorage *old_values) {
+    if (alloc == nullptr) {
+      delete[] old_keys;
+      delete[] old_values;
+    }
+  }
 
   size_t find_available_position(const K &key) {
     std::size_t index = hash_functor(key) % capacity;
@@ -88,8 +112,8 @@ class hash_table {
     std::size_t old_cap = this->capacity;
     this->capacity = find_prime(capacity * 2);
     this->size = 0;
-    this->keys = new key_pair[this->capacity];
-    this->values = new ValueStorage[this->capacity];
+    this->keys = allocate_keys(this->capacity);
+    this->values = allocate_values(this->capacity);
     for (std::size_t i = 0; i < old_cap; ++i) {
       if (!old_keys[i].is_gravestone) {
         insert(
@@ -97,8 +121,13 @@ class hash_table {
             std::move(*std::launder(reinterpret_cast<V *>(&old_values[i]))));
       }
     }
-    delete[] old_keys;
-    delete[] old_values;
+    deallocate(old_keys, old_values);
+  }
+
+  void destroy(std::size_t pos) {
+    std::launder(reinterpret_cast<K *>(&keys[pos].key))->~K();
+    std::launder(reinterpret_cast<V *>(&values[pos]))->~V();
+    keys[pos].is_gravestone = true;
   }
 
   void maybe_resize() {
@@ -118,12 +147,20 @@ public:
         keys(new key_pair[this->capacity]),
         values(new ValueStorage[this->capacity]) {}
 
+  // The slots and every resize of them come from alloc, which must outlive
+  // the table
+  hash_table(std::size_t capacity, arena *alloc)
+      : size(0), capacity(find_prime((int)capacity)), alloc(alloc) {
+    keys = allocate_keys(this->capacity);
+    values = allocate_values(this->capacity);
+  }
+
   hash_table(const hash_table &other) = delete;
   hash_table &operator=(const hash_table &other) = delete;
 
   hash_table(hash_table &&other) noexcept
       : size(other.size), capacity(other.capacity), keys(other.keys),
-        values(other.values) {
+        values(other.values), alloc(other.alloc) {
     other.size = 0;
     other.capacity = 0;
     other.keys = nullptr;
@@ -131,10 +168,15 @@ public:
   }
 
   hash_table &operator=(hash_table &&other) noexcept {
+    if (this == &other) {
+      return *this;
+    }
+    this->clear();
     this->size = other.size;
     this->capacity = other.capacity;
     this->keys = other.keys;
     this->values = other.values;
+    this->alloc = other.alloc;
 
     other.size = 0;
     other.capacity = 0;
@@ -153,9 +195,8 @@ public:
         std::launder(reinterpret_cast<V *>(&values[i]))->~V();
       }
     }
-    delete[] keys;
+    deallocate(keys, values);
     keys = nullptr;
-    delete[] values;
     values = nullptr;
   }
 
@@ -168,9 +209,8 @@ public:
         std::launder(reinterpret_cast<V *>(&values[i]))->~V();
       }
     }
-    delete[] keys;
+    deallocate(keys, values);
     keys = nullptr;
-    delete[] values;
     values = nullptr;
     capacity = 0;
     size = 0;
@@ -225,6 +265,10 @@ public:
   };
 
   [[nodiscard]] std::size_t get_size() const { return this->size; }
+  // The bytes of the slot arrays, used or not
+  [[nodiscard]] std::size_t get_memory() const {
+    return this->capacity * (sizeof(key_pair) + sizeof(ValueStorage));
+  }
 
   iterator lookup(const K &key) {
     auto pos = find_available_position(key);
@@ -235,13 +279,35 @@ public:
     }
   }
 
+  // Lookups stop at the first empty slot, so the entries after the removed
+  // one that probed past it are shifted back into the hole
   void remove(const K &key) {
     auto pos = find_available_position(key);
     if (pos >= 0 && !keys[pos].is_gravestone) {
-      std::launder(reinterpret_cast<K *>(&keys[pos].key))->~K();
-      std::launder(reinterpret_cast<V *>(&values[pos]))->~V();
-      keys[pos].is_gravestone = true;
+      destroy(pos);
       size--;
+      std::size_t hole = pos;
+      std::size_t i = pos;
+      while (true) {
+        i = i + 1 == capacity ? 0 : i + 1;
+        if (keys[i].is_gravestone) {
+          break;
+        }
+        std::size_t home = hash_functor(keys[i].get_key()) % capacity;
+        // Entries whose home slot is in (hole, i] are still reachable
+        bool reachable = hole <= i ? (hole < home && home <= i)
+                                   : (hole < home || home <= i);
+        if (reachable) {
+          continue;
+        }
+        auto k = std::launder(reinterpret_cast<K *>(&keys[i].key));
+        auto v = std::launder(reinterpret_cast<V *>(&values[i]));
+        new (&keys[hole].key) K(std::move(*k));
+        new (&values[hole]) V(std::move(*v));
+        keys[hole].is_gravestone = false;
+        destroy(i);
+        hole = i;
+      }
     }
   }
 
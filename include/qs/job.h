@@ -3,7 +3,12 @@
 
 namespace qs {
 
+class task_group;
+
 struct job {
+  // The group that waits for this job, if it was spawned through one
+  task_group *group = nullptr;
+
   virtual ~job() {}
   virtual void operator()() {}
 };
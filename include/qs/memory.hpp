@@ -1,6 +1,7 @@
 #ifndef QS_MEMORY_HPP
 #define QS_MEMORY_HPP
 
+#include <atomic>
 #include <memory>
 #include <qs/optional.hpp>
 #include <stdexcept>
@@ -58,6 +59,93 @@ unique_pointer<T> make_unique(Args &&...args) {
   return unique_pointer<T>(new T(std::forward<Args>(args)...));
 }
 
+// A reference counted pointer. Copies share ownership and the object is
+// deleted when the last copy is destroyed. The count is atomic so copies can
+// be released from any thread, but a single shared_pointer instance must not
+// be reassigned concurrently.
+template <typename T> class shared_pointer {
+  using pointer_type = typename std::add_pointer_t<T>;
+
+  struct control_block {
+    pointer_type data;
+    std::atomic<std::size_t> count;
+
+    explicit control_block(pointer_type d) : data(d), count(1) {}
+  };
+
+  control_block *block;
+
+  void release() {
+    if (block != nullptr &&
+        block->count.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      delete block->data;
+      delete block;
+    }
+    block = nullptr;
+  }
+
+public:
+  shared_pointer() : block(nullptr) {}
+  explicit shared_pointer(pointer_type d)
+      : block(d != nullptr ? new control_block(d) : nullptr) {}
+
+  shared_pointer(const shared_pointer &other) : block(other.block) {
+    if (block != nullptr) {
+      block->count.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+  shared_pointer &operator=(const shared_pointer &other) {
+    if (this != &other) {
+      if (other.block != nullptr) {
+        other.block->count.fetch_add(1, std::memory_order_relaxed);
+      }
+      release();
+      block = other.block;
+    }
+    return *this;
+  }
+
+  shared_pointer(shared_pointer &&other) noexcept : block(other.block) {
+    other.block = nullptr;
+  }
+  shared_pointer &operator=(shared_pointer &&other) noexcept {
+    if (this != &other) {
+      release();
+      block = other.block;
+      other.block = nullptr;
+    }
+    return *this;
+  }
+
+  ~shared_pointer() { release(); }
+
+  typename std::add_lvalue_reference_t<T> operator*() const {
+    return *this->operator->();
+  }
+
+  pointer_type operator->() const {
+    if (block != nullptr) {
+      return block->data;
+    } else {
+      throw std::runtime_error("Dereference of empty shared pointer");
+    }
+  }
+
+  pointer_type get() const { return this->operator->(); }
+
+  bool is_empty() const { return block == nullptr; }
+
+  std::size_t use_count() const {
+    return block != nullptr ? block->count.load(std::memory_order_relaxed)
+                            : 0;
+  }
+};
+
+template <typename T, class... Args>
+shared_pointer<T> make_shared(Args &&...args) {
+  return shared_pointer<T>(new T(std::forward<Args>(args)...));
+}
+
 } // namespace qs
 
 #endif
@@ -0,0 +1,130 @@
+#ifndef QS_METRICS_HPP
+#define QS_METRICS_HPP
+
+#include <atomic>
+#include <ctime>
+
+#include <qs/core.h>
+
+// Counters and latency histograms that cost one relaxed load and a branch
+// while they are disabled. Build with -Dmetrics=false to compile them out.
+//
+// Every thread updates its own block so recording never contends. Reading
+// sums the blocks of all the threads without stopping them, so the values are
+// only approximate while the threads are running.
+
+#define QS_METRICS_MAX_COUNTERS 64
+#define QS_METRICS_MAX_HISTOGRAMS 32
+#define QS_METRICS_MAX_NAME 48
+// Threads past this many share one block
+#define QS_METRICS_MAX_THREADS 256
+
+// HDR style buckets: values below 2^QS_HISTOGRAM_SUB_BITS get a bucket each
+// and every larger power of two is split in 2^QS_HISTOGRAM_SUB_BITS buckets,
+// so a value is reported at most 1/16th above what was recorded. Values of
+// 2^QS_HISTOGRAM_MAX_BITS and more end up in the last bucket
+#define QS_HISTOGRAM_SUB_BITS 4
+#define QS_HISTOGRAM_MAX_BITS 40
+#define QS_HISTOGRAM_BUCKETS                                                   \
+  ((QS_HISTOGRAM_MAX_BITS - QS_HISTOGRAM_SUB_BITS + 1)                         \
+   << QS_HISTOGRAM_SUB_BITS)
+
+namespace qs {
+namespace metrics {
+
+struct counter {
+  u32 id;
+};
+
+struct histogram {
+  u32 id;
+};
+
+struct histogram_summary {
+  u64 count;
+  u64 sum;
+  u64 max;
+  u64 p50;
+  u64 p90;
+  u64 p99;
+  u64 p999;
+};
+
+// Registering a name twice returns the same metric. Throws once the registry
+// is full
+counter register_counter(const char *name);
+histogram register_histogram(const char *name);
+
+extern std::atomic<bool> enabled_flag;
+
+inline bool enabled() {
+#ifdef QS_METRICS_DISABLED
+  return false;
+#else
+  return enabled_flag.load(std::memory_order_relaxed);
+#endif
+}
+
+void set_enabled(bool enabled);
+
+void add_enabled(counter c, u64 n);
+void record_enabled(histogram h, u64 value);
+
+inline void add(counter c, u64 n = 1) {
+  if (enabled()) {
+    add_enabled(c, n);
+  }
+}
+
+inline void record(histogram h, u64 value) {
+  if (enabled()) {
+    record_enabled(h, value);
+  }
+}
+
+inline u64 now_ns() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (u64)ts.tv_sec * 1000000000ull + (u64)ts.tv_nsec;
+}
+
+// The start of a measurement, 0 while the metrics are disabled
+inline u64 start() { return enabled() ? now_ns() : 0; }
+
+// Records the nanoseconds since start unless start is 0
+inline void record_since(histogram h, u64 start) {
+  if (start != 0) {
+    record_enabled(h, now_ns() - start);
+  }
+}
+
+// Records the nanoseconds from its construction to the end of the scope
+class scoped_timer {
+  histogram h;
+  u64 begin;
+
+public:
+  explicit scoped_timer(histogram h) : h(h), begin(start()) {}
+  scoped_timer(const scoped_timer &other) = delete;
+  scoped_timer &operator=(const scoped_timer &other) = delete;
+  ~scoped_timer() { record_since(h, begin); }
+};
+
+u64 get_counter(counter c);
+histogram_summary get_histogram(histogram h);
+
+// Zeroes every metric. Values recorded at the same time may survive
+void reset();
+
+// Writes every metric as text to fd. It neither allocates nor locks so it is
+// safe to call from a signal handler
+void dump(int fd);
+
+// Dumps the metrics to fd whenever the process gets signum. Returns false if
+// the handler could not be installed
+bool dump_on_signal(int signum, int fd);
+
+} // namespace metrics
+} // namespace qs
+
+#endif // QS_METRICS_HPP
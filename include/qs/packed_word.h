@@ -0,0 +1,51 @@
+#ifndef QS_PACKED_WORD_H
+#define QS_PACKED_WORD_H
+
+#include <cstring>
+
+#include <qs/core.h>
+#include <qs/string_view.h>
+
+namespace qs {
+
+#define QS_PACKED_WORD_SIZE 32
+
+// A word stored inline in a fixed, zero padded 32 byte slot. Every word of the
+// SIGMOD workload fits (MAX_WORD_LENGTH is 31) so distance kernels can always
+// load a whole slot with one vector instruction. The last byte of the slot is
+// never part of the word and holds its length.
+struct alignas(QS_PACKED_WORD_SIZE) packed_word {
+  char data[QS_PACKED_WORD_SIZE];
+
+  packed_word() : data{} {}
+  explicit packed_word(qs::string_view w) : data{} {
+    auto length = w.size();
+    if (length >= QS_PACKED_WORD_SIZE) {
+      throw std::runtime_error("word does not fit in a packed word slot");
+    }
+    std::memcpy(data, w.data(), length);
+    data[QS_PACKED_WORD_SIZE - 1] = (char)length;
+  }
+
+  QS_FORCE_INLINE std::size_t size() const {
+    return (u8)data[QS_PACKED_WORD_SIZE - 1];
+  }
+
+  // The returned view points into the slot so it is only valid as long as the
+  // packed_word is alive
+  QS_FORCE_INLINE string_view get_string_view() const {
+    auto length = size();
+    return length ? string_view{data, data + length - 1} : string_view{};
+  }
+
+  QS_FORCE_INLINE bool operator==(const packed_word &other) const {
+    return std::memcmp(data, other.data, QS_PACKED_WORD_SIZE) == 0;
+  }
+  QS_FORCE_INLINE bool operator!=(const packed_word &other) const {
+    return !(*this == other);
+  }
+};
+
+} // namespace qs
+
+#endif // QS_PACKED_WORD_H
@@ -1,6 +1,9 @@
 #ifndef QS_PARSER_HPP
 #define QS_PARSER_HPP
+#include <algorithm>
 #include <cstdio>
+#include <cstring>
+#include <qs/core.h>
 #include <qs/string.h>
 #include <qs/string_view.h>
 
@@ -19,13 +22,53 @@ template <typename Fn> void parse_file(FILE *stream, char del, Fn f) {
   std::free(line);
 }
 
+// Delimiters are searched 64 bytes at a time
+#define QS_PARSER_BLOCK 64
+// The blocks scanned by one call to delimiter_masks
+#define QS_PARSER_BATCH 16
+
+// Sets bit i of masks[b] when data[b * QS_PARSER_BLOCK + i] is del. Uses AVX2
+// or SSE2 when the CPU has them
+void delimiter_masks(const char *data, std::size_t blocks, char del,
+                     u64 *masks);
+
+// Calls f with every non empty token of the first length bytes of stream
 template <typename Fn>
-void parse_string(const char *stream, const char del, Fn f) {
-  qs::string_view token;
-  qs::string_view stream_view{stream};
-  while ((token = stream_view.split(del)) != qs::string_view::empty) {
-    f(token);
+void parse_string(const char *stream, std::size_t length, const char del,
+                  Fn f) {
+  const char *token = stream;
+  auto emit = [&token, &f](const char *delimiter) {
+    if (delimiter != token) {
+      qs::string_view view{token, delimiter - 1};
+      f(view);
+    }
+    token = delimiter + 1;
+  };
+
+  u64 masks[QS_PARSER_BATCH];
+  std::size_t blocks = length / QS_PARSER_BLOCK;
+  for (std::size_t b = 0; b < blocks; b += QS_PARSER_BATCH) {
+    std::size_t batch = std::min<std::size_t>(QS_PARSER_BATCH, blocks - b);
+    auto base = stream + b * QS_PARSER_BLOCK;
+    delimiter_masks(base, batch, del, masks);
+    for (std::size_t i = 0; i < batch; i++) {
+      for (u64 mask = masks[i]; mask != 0; mask &= mask - 1) {
+        emit(base + i * QS_PARSER_BLOCK + __builtin_ctzll(mask));
+      }
+    }
   }
+  const char *end = stream + length;
+  for (auto c = stream + blocks * QS_PARSER_BLOCK; c != end; c++) {
+    if (*c == del) {
+      emit(c);
+    }
+  }
+  emit(end);
+}
+
+template <typename Fn>
+void parse_string(const char *stream, const char del, Fn f) {
+  parse_string(stream, std::strlen(stream), del, f);
 }
 } // namespace qs
 #endif // QS_PARSER_HPP
@@ -0,0 +1,193 @@
+#ifndef QS_PARTITION_INDEX_HPP
+#define QS_PARTITION_INDEX_HPP
+
+#include <algorithm>
+
+#include <qs/bk_tree.hpp>
+#include <qs/core.h>
+#include <qs/hash.h>
+#include <qs/hash_table.hpp>
+#include <qs/list.hpp>
+#include <qs/packed_word.h>
+#include <qs/vector.hpp>
+
+namespace qs {
+
+// The biggest threshold a partition_index is split for
+#define QS_PARTITION_INDEX_MAX_DIST 3
+
+// A frozen pigeonhole index of the words of a bk_tree for hamming distance
+// searches, built and read like a flat_bk_tree. Every word is cut in
+// max_dist + 1 segments and two words of the same length that differ in at
+// most max_dist letters have at least one segment in common, so every
+// segment is indexed exactly and a search only verifies the words that share
+// a segment with the query.
+//
+// A word is verified at the first segment it shares with the query and
+// skipped at the next ones, so no search state is kept. Searches with a
+// threshold above max_dist verify every word of the length of the query.
+template <typename T> class partition_index {
+  struct segment_range {
+    u32 begin;
+    u32 count;
+  };
+
+  struct segment_word {
+    u64 hash;
+    u32 word;
+
+    bool operator<(const segment_word &other) const {
+      return hash != other.hash ? hash < other.hash : word < other.word;
+    }
+  };
+
+  distance_function dist_func{};
+  int max_dist = 0;
+  qs::vector<T> data;
+  // The words of every segment, grouped by segment
+  qs::vector<u32> words;
+  // lookup() does not modify the table, it is only not marked const
+  mutable qs::hash_table<u64, segment_range> segments{1};
+
+  // The first letter of segment i of a word of the given length
+  QS_FORCE_INLINE int segment_begin(std::size_t length, int i) const {
+    return (int)(length * i / (this->max_dist + 1));
+  }
+
+  // Segments are only compared with the segments at the same position of
+  // words of the same length
+  QS_FORCE_INLINE u64 segment_hash(qs::string_view word, int i) const {
+    int begin = segment_begin(word.size(), i);
+    int end = segment_begin(word.size(), i + 1);
+    return hash_detail::mix(hash_bytes(word.data() + begin, end - begin),
+                            (u64)word.size() << 8 | (u64)i);
+  }
+
+  QS_FORCE_INLINE bool same_segment(qs::string_view a, qs::string_view b,
+                                    int i) const {
+    int begin = segment_begin(a.size(), i);
+    int end = segment_begin(a.size(), i + 1);
+    return std::memcmp(a.data() + begin, b.data() + begin, end - begin) == 0;
+  }
+
+public:
+  partition_index() = default;
+
+  partition_index(const partition_index &other) = delete;
+  partition_index &operator=(const partition_index &other) = delete;
+  partition_index(partition_index &&other) noexcept = default;
+  partition_index &operator=(partition_index &&other) noexcept = default;
+
+  // Throws away the current index and builds it from the words of tree that
+  // were not removed, with the data of every word produced by copy_data
+  template <typename Fn>
+  void rebuild(const bk_tree<T> &tree, int max_dist, Fn copy_data) {
+    if (max_dist > QS_PARTITION_INDEX_MAX_DIST) {
+      throw std::runtime_error("too many segments for a partition_index");
+    }
+    std::size_t size = tree.get_size() > 0 ? tree.get_size() : 1;
+    this->dist_func = tree.dist_func;
+    this->max_dist = max_dist;
+    this->data = qs::vector<T>{size + 1};
+    tree.for_each([this, &copy_data](const T &d) {
+      this->data.push(copy_data(d));
+    });
+
+    std::size_t count = this->data.get_size() * (max_dist + 1);
+    qs::vector<segment_word> pairs{count + 1};
+    auto data_p = this->data.get_data();
+    for (u32 w = 0; w < this->data.get_size(); w++) {
+      auto word = data_p[w].get_string_view();
+      for (int i = 0; i <= max_dist; i++) {
+        pairs.push(segment_word{segment_hash(word, i), w});
+      }
+    }
+    auto pairs_p = pairs.get_data();
+    std::sort(pairs_p, pairs_p + count);
+
+    std::size_t distinct = 0;
+    for (std::size_t i = 0; i < count; i++) {
+      distinct += i == 0 || pairs_p[i].hash != pairs_p[i - 1].hash;
+    }
+    this->words = qs::vector<u32>{count + 1};
+    this->segments = qs::hash_table<u64, segment_range>{distinct * 2 + 1};
+    for (std::size_t i = 0; i < count;) {
+      std::size_t j = i;
+      while (j < count && pairs_p[j].hash == pairs_p[i].hash) {
+        this->words.push(pairs_p[j++].word);
+      }
+      this->segments.insert(pairs_p[i].hash,
+                            segment_range{(u32)i, (u32)(j - i)});
+      i = j;
+    }
+  }
+
+  // The number of words
+  std::size_t get_size() const { return this->data.get_size(); }
+  distance_function get_distance_function() const { return this->dist_func; }
+  int get_max_dist() const { return this->max_dist; }
+
+  const T *begin() const { return this->data.get_data(); }
+  const T *end() const { return this->data.get_data() + this->data.get_size(); }
+
+  template <typename Q>
+  qs::linked_list<T *> match(int threshold, const Q &query) const {
+    qs::linked_list<T *> ret{};
+    this->traverse(threshold, query,
+                   [&ret](T *data, int) { ret.append(data); });
+    return ret;
+  }
+
+  // Calls on_match with the data and the hamming distance of every word
+  // within threshold of query. Returns the number of words verified
+  template <typename Q, typename Fn>
+  std::size_t traverse(int threshold, const Q &query, Fn on_match) const {
+    auto q = query.get_string_view();
+    auto data_p = this->data.get_data();
+    std::size_t verified = 0;
+    auto verify = [&](u32 index) {
+      int d = (*this->dist_func)(data_p[index].get_string_view(), q);
+      verified++;
+      if (d <= threshold) {
+        on_match(&data_p[index], d);
+      }
+    };
+    if (threshold > this->max_dist) {
+      for (u32 i = 0; i < this->data.get_size(); i++) {
+        if (data_p[i].get_string_view().size() == q.size()) {
+          verify(i);
+        }
+      }
+      return verified;
+    }
+
+    auto words_p = this->words.get_data();
+    for (int i = 0; i <= this->max_dist; i++) {
+      auto range = this->segments.lookup(segment_hash(q, i));
+      if (range == this->segments.end()) {
+        continue;
+      }
+      for (u32 r = range->begin; r != range->begin + range->count; r++) {
+        u32 index = words_p[r];
+        auto word = data_p[index].get_string_view();
+        // Words that only share the hash, or that were verified at an
+        // earlier segment
+        if (word.size() != q.size() || !same_segment(word, q, i)) {
+          continue;
+        }
+        int first = 0;
+        while (first < i && !same_segment(word, q, first)) {
+          first++;
+        }
+        if (first == i) {
+          verify(index);
+        }
+      }
+    }
+    return verified;
+  }
+};
+
+} // namespace qs
+
+#endif // QS_PARTITION_INDEX_HPP
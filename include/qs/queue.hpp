@@ -1,11 +1,15 @@
 #ifndef QS_QUEUE_H
 #define QS_QUEUE_H
 
+#include "core.h"
 #include "error.h"
 #include "list.hpp"
 #include "optional.hpp"
+#include <atomic>
 #include <iostream>
+#include <new>
 #include <pthread.h>
+#include <sched.h>
 
 namespace qs {
 
@@ -126,6 +130,219 @@ public:
     QS_UNWRAP(pthread_mutex_unlock(&this->mutex));
   }
 };
+
+// Failed attempts of a blocking enqueue or dequeue before it parks. The
+// attempts back off by yielding the cpu to the other side
+#define QS_MPMC_SPINS 64
+
+// A bounded lock free multi producer multi consumer queue on a ring of slots
+// (Vyukov's bounded MPMC queue). Every slot carries a sequence number that
+// tells producers and consumers whose turn it is, so a successful try_enqueue
+// or try_dequeue is a single CAS on the tail or the head and nothing is
+// allocated after construction.
+//
+// The blocking variants only take a lock once the queue stays full or empty
+// for QS_MPMC_SPINS attempts and park on a condition variable until the other
+// side makes progress or the queue is closed.
+template <class T> class mpmc_queue {
+  struct slot {
+    std::atomic<std::size_t> sequence;
+    alignas(T) unsigned char storage[sizeof(T)];
+
+    T *get() { return reinterpret_cast<T *>(storage); }
+  };
+
+  slot *slots;
+  std::size_t mask;
+
+  alignas(QS_CACHE_LINE_SIZE) std::atomic<std::size_t> head{0};
+  alignas(QS_CACHE_LINE_SIZE) std::atomic<std::size_t> tail{0};
+  alignas(QS_CACHE_LINE_SIZE) std::atomic<std::size_t> waiting_consumers{0};
+  std::atomic<std::size_t> waiting_producers{0};
+  std::atomic<bool> closed{false};
+  pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+  pthread_cond_t not_empty = PTHREAD_COND_INITIALIZER;
+  pthread_cond_t not_full = PTHREAD_COND_INITIALIZER;
+
+  // The waiting counters are bumped before the waiter retries under the lock
+  // so either the waiter sees the change or the other side sees the waiter
+  void wake(std::atomic<std::size_t> &waiting, pthread_cond_t *cond) {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (waiting.load(std::memory_order_relaxed) > 0) {
+      QS_UNWRAP(pthread_mutex_lock(&this->mutex));
+      QS_UNWRAP(pthread_cond_signal(cond));
+      QS_UNWRAP(pthread_mutex_unlock(&this->mutex));
+    }
+  }
+
+  template <class U> bool push(U &&item) {
+    std::size_t pos = tail.load(std::memory_order_relaxed);
+    while (true) {
+      slot &s = slots[pos & mask];
+      std::size_t seq = s.sequence.load(std::memory_order_acquire);
+      auto diff = (std::ptrdiff_t)(seq - pos);
+      if (diff == 0) {
+        if (tail.compare_exchange_weak(pos, pos + 1,
+                                       std::memory_order_relaxed)) {
+          new (s.get()) T(std::forward<U>(item));
+          s.sequence.store(pos + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = tail.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  bool pop(T &out) {
+    std::size_t pos = head.load(std::memory_order_relaxed);
+    while (true) {
+      slot &s = slots[pos & mask];
+      std::size_t seq = s.sequence.load(std::memory_order_acquire);
+      auto diff = (std::ptrdiff_t)(seq - (pos + 1));
+      if (diff == 0) {
+        if (head.compare_exchange_weak(pos, pos + 1,
+                                       std::memory_order_relaxed)) {
+          out = std::move(*s.get());
+          s.get()->~T();
+          s.sequence.store(pos + mask + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = head.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  template <class U> bool enqueue_blocking(U &&item) {
+    for (int spins = 0; spins < QS_MPMC_SPINS; spins++) {
+      if (try_enqueue(std::forward<U>(item))) {
+        return true;
+      }
+      sched_yield();
+    }
+    QS_UNWRAP(pthread_mutex_lock(&this->mutex));
+    waiting_producers.fetch_add(1, std::memory_order_seq_cst);
+    bool pushed;
+    while (!(pushed = push(std::forward<U>(item))) && !closed.load()) {
+      QS_UNWRAP(pthread_cond_wait(&this->not_full, &this->mutex));
+    }
+    waiting_producers.fetch_sub(1, std::memory_order_relaxed);
+    QS_UNWRAP(pthread_mutex_unlock(&this->mutex));
+    if (pushed) {
+      wake(waiting_consumers, &this->not_empty);
+    }
+    return pushed;
+  }
+
+public:
+  // capacity is rounded up to a power of two
+  explicit mpmc_queue(std::size_t capacity) {
+    std::size_t size = 2;
+    while (size < capacity) {
+      size *= 2;
+    }
+    slots = new slot[size];
+    mask = size - 1;
+    for (std::size_t i = 0; i < size; i++) {
+      slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  mpmc_queue(const mpmc_queue &other) = delete;
+  mpmc_queue &operator=(const mpmc_queue &other) = delete;
+
+  ~mpmc_queue() {
+    for (std::size_t pos = head.load(); pos != tail.load(); pos++) {
+      slots[pos & mask].get()->~T();
+    }
+    delete[] slots;
+    pthread_mutex_destroy(&this->mutex);
+    pthread_cond_destroy(&this->not_empty);
+    pthread_cond_destroy(&this->not_full);
+  }
+
+  std::size_t get_capacity() const { return mask + 1; }
+
+  // Approximate when called concurrently with the other operations
+  std::size_t size() const {
+    std::size_t t = tail.load(std::memory_order_relaxed);
+    std::size_t h = head.load(std::memory_order_relaxed);
+    return t > h ? t - h : 0;
+  }
+
+  bool is_closed() const { return closed.load(); }
+
+  // Returns false if the queue is full
+  bool try_enqueue(const T &item) {
+    if (push(item)) {
+      wake(waiting_consumers, &this->not_empty);
+      return true;
+    }
+    return false;
+  }
+  bool try_enqueue(T &&item) {
+    if (push(std::move(item))) {
+      wake(waiting_consumers, &this->not_empty);
+      return true;
+    }
+    return false;
+  }
+
+  // Returns false if the queue is empty
+  bool try_dequeue(T &out) {
+    if (pop(out)) {
+      wake(waiting_producers, &this->not_full);
+      return true;
+    }
+    return false;
+  }
+
+  // Blocks while the queue is full. Returns false if the queue was closed
+  // while waiting for a free slot
+  bool enqueue(const T &item) { return enqueue_blocking(item); }
+  bool enqueue(T &&item) { return enqueue_blocking(std::move(item)); }
+
+  // Blocks while the queue is empty. Returns nothing only if the queue has
+  // been closed and drained
+  qs::optional<T> dequeue() {
+    T item;
+    for (int spins = 0; spins < QS_MPMC_SPINS; spins++) {
+      if (try_dequeue(item)) {
+        return qs::optional<T>{std::move(item)};
+      }
+      sched_yield();
+    }
+    QS_UNWRAP(pthread_mutex_lock(&this->mutex));
+    waiting_consumers.fetch_add(1, std::memory_order_seq_cst);
+    bool popped;
+    while (!(popped = pop(item)) && !closed.load()) {
+      QS_UNWRAP(pthread_cond_wait(&this->not_empty, &this->mutex));
+    }
+    waiting_consumers.fetch_sub(1, std::memory_order_relaxed);
+    QS_UNWRAP(pthread_mutex_unlock(&this->mutex));
+    if (popped) {
+      wake(waiting_producers, &this->not_full);
+      return qs::optional<T>{std::move(item)};
+    }
+    return qs::optional<T>();
+  }
+
+  // Wakes up every blocked producer and consumer. Items that are already in
+  // the queue can still be dequeued
+  void close() {
+    QS_UNWRAP(pthread_mutex_lock(&this->mutex));
+    closed.store(true);
+    QS_UNWRAP(pthread_cond_broadcast(&this->not_empty));
+    QS_UNWRAP(pthread_cond_broadcast(&this->not_full));
+    QS_UNWRAP(pthread_mutex_unlock(&this->mutex));
+  }
+};
+
 } // namespace qs
 
 #endif
@@ -1,64 +1,87 @@
 #ifndef QS_SCHEDULER_H
 #define QS_SCHEDULER_H
 
-#include <qs/cyclic_buffer.hpp>
+#include <atomic>
+#include <pthread.h>
+
+#include <qs/core.h>
 #include <qs/job.h>
 #include <qs/queue.hpp>
 #include <qs/vector.hpp>
 
 namespace qs {
 
+// How many times an idle worker polls for new work before it parks on its
+// condition variable. Spinning hides the wake up latency of back to back jobs
+// while parking keeps an idle pool from using any cpu
+#define QS_DEFAULT_SPIN_BUDGET 256
+
 class worker {
-  concurrent_queue<qs::job *> queue;
+  pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+  pthread_cond_t job_available = PTHREAD_COND_INITIALIZER;
+  pthread_cond_t drained = PTHREAD_COND_INITIALIZER;
+  queue<job *> jobs;
+  // Jobs that are queued or running
+  std::atomic<std::size_t> pending{0};
+  bool parked = false;
+  bool closed = false;
 
 public:
-  void enqueue(job *j) { queue.enqueue(j); }
-
-  void start() {
-    while (true) {
-      auto job = queue.peek();
-      if (queue.is_closed()) {
-        break;
-      }
-      if (job != nullptr) {
-        (**job)();
-        delete *job;
-        queue.dequeue(nullptr);
-      }
-    }
-  }
+  std::size_t spin_budget = QS_DEFAULT_SPIN_BUDGET;
+
+  worker() = default;
+  worker(const worker &other) = delete;
+  worker &operator=(const worker &other) = delete;
+  ~worker();
+
+  void enqueue(job *j);
+
+  // Runs jobs until the worker is stopped and its queue is empty
+  void start();
+
+  void stop();
 
-  void stop() { queue.close(); }
+  // Blocks until every job enqueued so far has finished running
+  void wait_done();
 
-  void wait_done() { queue.wait_empty(); }
+  std::size_t get_pending() const {
+    return pending.load(std::memory_order_relaxed);
+  }
 };
 
 class scheduler {
 private:
   qs::vector<pthread_t> thread_pool;
-  qs::vector<worker> workers;
+  worker *workers;
+  std::size_t workers_count;
   std::size_t current_worker = 0;
 
   static void *start_worker(qs::worker *sched);
 
 public:
   scheduler() = delete;
-  explicit scheduler(std::size_t threads_count);
+  explicit scheduler(std::size_t threads_count,
+                     std::size_t spin_budget = QS_DEFAULT_SPIN_BUDGET);
+  scheduler(const scheduler &other) = delete;
+  scheduler &operator=(const scheduler &other) = delete;
 
-  ~scheduler() {
-    for (auto &worker : workers) {
-      worker.stop();
-    }
-    for (auto &thread_id : thread_pool) {
-      pthread_join(thread_id, nullptr);
-    }
-  }
+  // Runs the jobs that are still queued and joins the workers
+  ~scheduler();
 
   void submit_job(job *j) {
     workers[current_worker].enqueue(j);
-    current_worker = (current_worker + 1) % workers.get_size();
+    current_worker = (current_worker + 1) % workers_count;
   }
   void wait_all_finish();
+
+  // Jobs that are queued or running, approximate while jobs are submitted
+  std::size_t get_pending_jobs() const {
+    std::size_t n = 0;
+    for (std::size_t i = 0; i < workers_count; i++) {
+      n += workers[i].get_pending();
+    }
+    return n;
+  }
 };
 
 } // namespace qs
@@ -255,7 +255,7 @@ public:
   }
 
   void remove(iterator iter) {
-    skip_list_node *n = iter->curr;
+    skip_list_node *n = iter.curr;
     if (n == nullptr) {
       return;
     }
@@ -309,7 +309,7 @@ public:
 
     iterator(const iterator &other) : curr(other.curr), prev(other.prev) {}
     iterator &operator=(const iterator &other) {
-      if (this != other) {
+      if (this != &other) {
         this->curr = other.curr;
         this->prev = other.prev;
       }
@@ -183,7 +183,7 @@ public:
 template <> struct std::hash<qs::string> {
 
   std::size_t operator()(qs::string const &s) const noexcept {
-    return qs::djb2((const uint8_t *)s.data());
+    return qs::hash_bytes(s.data(), s.length());
   }
 };
 
@@ -2,6 +2,7 @@
 #define QS_STRING_VIEW_H
 
 #include <qs/core.h>
+#include <qs/hash.h>
 #include <qs/string.h>
 
 namespace qs {
@@ -105,14 +106,7 @@ public:
 template <> struct std::hash<qs::string_view> {
 
   std::size_t operator()(qs::string_view const &s) const noexcept {
-    u64 hash = 5381;
-    auto str = s.data();
-    i32 c;
-    while (str != s.last() + 1) {
-      c = *str++;
-      hash = ((hash << 5) + hash) + c; /* hash * 33 + c */
-    }
-    return hash;
+    return qs::hash_bytes(s.data(), s.size());
   }
 };
 
@@ -9,6 +9,7 @@
 #include <stdexcept>
 #include <utility>
 
+#include <qs/arena.hpp>
 #include <qs/functions.hpp>
 
 namespace qs {
@@ -18,14 +19,25 @@ private:
   T_storage *data;
   std::size_t size;
   std::size_t capacity;
+  // Where the buffer comes from. nullptr means the heap
+  arena *alloc = nullptr;
+
+  T_storage *allocate(std::size_t n) {
+    return alloc != nullptr ? alloc->allocate<T_storage>(n) : new T_storage[n];
+  }
+  void deallocate(T_storage *p) {
+    if (alloc == nullptr) {
+      delete[] p;
+    }
+  }
 
   void resize() {
     capacity = (std::size_t)(capacity * 1.5);
-    T_storage *new_data_slice = new T_storage[capacity];
+    T_storage *new_data_slice = allocate(capacity);
     functions::copy_uninitialized(data, data + size, new_data_slice);
     T_storage *old_data_slice = data;
     data = new_data_slice;
-    delete[] old_data_slice;
+    deallocate(old_data_slice);
   }
 
   void maybe_resize() {
@@ -38,16 +50,22 @@ public:
   vector() : data(new T_storage[10]), size(0), capacity(10) {}
   explicit vector(std::size_t capacity)
       : data(new T_storage[capacity]), size(0), capacity(capacity) {}
+  // The buffer and every reallocation of it come from alloc, which must
+  // outlive the vector
+  vector(std::size_t capacity, arena *alloc)
+      : size(0), capacity(capacity), alloc(alloc) {
+    data = allocate(capacity);
+  }
 
-  // Copy operations
+  // Copy operations. The copy uses the same arena as other
   vector(const vector &other)
-      : data(new T_storage[other.capacity]), size(other.size),
-        capacity(other.capacity) {
+      : size(other.size), capacity(other.capacity), alloc(other.alloc) {
+    data = allocate(other.capacity);
     functions::copy_uninitialized(other.cbegin(), other.cend(), this->begin());
   }
   vector &operator=(const vector &other) {
     if (this != &other) {
-      T_storage *new_data = new T_storage[other.capacity];
+      T_storage *new_data = allocate(other.capacity);
       T_storage *old_data = data;
       functions::copy_uninitialized(
           other.begin(), other.end(),
@@ -55,7 +73,7 @@ public:
       data = new_data;
       capacity = other.capacity;
       size = other.size;
-      delete[] old_data;
+      deallocate(old_data);
     }
     return *this;
   };
@@ -65,6 +83,7 @@ public:
     data = other.data;
     size = other.size;
     capacity = other.capacity;
+    alloc = other.alloc;
 
     other.data = nullptr;
     other.size = 0;
@@ -77,6 +96,7 @@ public:
       data = other.data;
       size = other.size;
       capacity = other.capacity;
+      alloc = other.alloc;
 
       other.data = nullptr;
       other.size = 0;
@@ -91,7 +111,7 @@ public:
       for (std::size_t i = 0; i < size; ++i) {
         std::launder(reinterpret_cast<T *>(&data[i]))->~T();
       }
-      delete[] data;
+      deallocate(data);
     }
   }
 
@@ -147,6 +167,24 @@ public:
 
   std::size_t get_size() const { return size; }
 
+  // Removes the last element and returns it. The vector must not be empty
+  T pop() {
+    size--;
+    T *last = std::launder(reinterpret_cast<T *>(&data[size]));
+    T ret{std::move(*last)};
+    last->~T();
+    return ret;
+  }
+
+  // Destroys every element but keeps the buffer so it can be filled again
+  // without allocating
+  void clear() {
+    for (std::size_t i = 0; i < size; ++i) {
+      std::launder(reinterpret_cast<T *>(&data[i]))->~T();
+    }
+    size = 0;
+  }
+
   // Returns a reference to the underlying buffer. IT SHOULD NOT BE MODIFIED
   T *get_data() const { return std::launder(reinterpret_cast<T *>(data)); }
 
@@ -0,0 +1,55 @@
+#ifndef QS_WORD_DICTIONARY_HPP
+#define QS_WORD_DICTIONARY_HPP
+
+#include <cstdint>
+
+#include <qs/core.h>
+#include <qs/hash_table.hpp>
+#include <qs/packed_word.h>
+#include <qs/string_view.h>
+
+namespace qs {
+
+#define QS_DICTIONARY_CHUNK_BITS 12
+#define QS_DICTIONARY_CHUNK_SIZE (1u << QS_DICTIONARY_CHUNK_BITS)
+#define QS_DICTIONARY_MAX_CHUNKS 4096
+
+// Interns words to dense u32 IDs. Every distinct word is stored exactly once,
+// in a packed_word slot, and the slots are laid out contiguously in chunks of
+// QS_DICTIONARY_CHUNK_SIZE words that never move. An ID or a pointer to a slot
+// therefore stays valid for the lifetime of the dictionary, and any thread
+// that was handed an ID after it was interned can read its word without
+// locking.
+//
+// intern() and find() must not run concurrently with intern().
+class word_dictionary {
+  // The keys point into the slots
+  hash_table<string_view, u32> ids;
+  packed_word *chunks[QS_DICTIONARY_MAX_CHUNKS] = {};
+  u32 count = 0;
+
+public:
+  static constexpr u32 npos = UINT32_MAX;
+
+  word_dictionary() : ids{4096} {}
+  word_dictionary(const word_dictionary &other) = delete;
+  word_dictionary &operator=(const word_dictionary &other) = delete;
+  ~word_dictionary();
+
+  // Returns the ID of word, adding it if it is not in the dictionary
+  u32 intern(string_view word);
+
+  // Returns the ID of word or npos
+  u32 find(string_view word);
+
+  QS_FORCE_INLINE const packed_word &get(u32 id) const {
+    return chunks[id >> QS_DICTIONARY_CHUNK_BITS]
+                 [id & (QS_DICTIONARY_CHUNK_SIZE - 1)];
+  }
+
+  u32 get_size() const { return count; }
+};
+
+} // namespace qs
+
+#endif // QS_WORD_DICTIONARY_HPP
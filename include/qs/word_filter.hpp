@@ -0,0 +1,83 @@
+#ifndef QS_WORD_FILTER_HPP
+#define QS_WORD_FILTER_HPP
+
+#include <stdexcept>
+
+#include <qs/bk_tree.hpp>
+#include <qs/core.h>
+#include <qs/distances.hpp>
+#include <qs/string_view.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace qs {
+
+#define QS_WORD_FILTER_BUCKETS 32
+
+// The letter counts of a word, kept next to it by the indices so a lower
+// bound of the edit distance to the query can rule it out before the
+// distance itself is computed. An edit changes the count of at most two
+// letters by one, in opposite directions, so the edit distance of two words
+// is at least half the sum of the differences of their counts, and at least
+// the difference of their lengths.
+//
+// Letters are counted in QS_WORD_FILTER_BUCKETS buckets by their low bits,
+// which gives every lowercase letter a bucket of its own. The last bucket
+// holds the length of the word instead so the same sum also includes the
+// difference of the lengths.
+struct alignas(QS_WORD_FILTER_BUCKETS) word_filter {
+  u8 counts[QS_WORD_FILTER_BUCKETS];
+
+  word_filter() : counts{} {}
+  explicit word_filter(qs::string_view w) : counts{} {
+    if (w.size() > 255) {
+      throw std::runtime_error("word does not fit in a word filter");
+    }
+    for (std::size_t i = 0; i < w.size(); i++) {
+      u32 bucket = (u8)w.data()[i] % QS_WORD_FILTER_BUCKETS;
+      counts[bucket == QS_WORD_FILTER_BUCKETS - 1 ? 0 : bucket]++;
+    }
+    counts[QS_WORD_FILTER_BUCKETS - 1] = (u8)w.size();
+  }
+
+  // A lower bound of the edit distance of the words of the two filters
+  QS_FORCE_INLINE int lower_bound(const word_filter &other) const {
+#if defined(__SSE2__)
+    auto a = reinterpret_cast<const __m128i *>(counts);
+    auto b = reinterpret_cast<const __m128i *>(other.counts);
+    __m128i sums = _mm_add_epi64(_mm_sad_epu8(_mm_load_si128(a),
+                                              _mm_load_si128(b)),
+                                 _mm_sad_epu8(_mm_load_si128(a + 1),
+                                              _mm_load_si128(b + 1)));
+    int sum = _mm_cvtsi128_si32(sums) +
+              _mm_cvtsi128_si32(_mm_unpackhi_epi64(sums, sums));
+#else
+    int sum = 0;
+    for (int i = 0; i < QS_WORD_FILTER_BUCKETS; i++) {
+      int diff = (int)counts[i] - (int)other.counts[i];
+      sum += diff < 0 ? -diff : diff;
+    }
+#endif
+    return sum / 2;
+  }
+};
+
+// The indices only keep word filters for these distances. The bound also
+// holds for hamming distances but the hamming kernels cost about as much as
+// the filter
+inline bool has_word_filter(distance_function f) {
+  return f == &edit_distance || f == &bit_parallel_edit_distance;
+}
+
+// How many candidates a search checked against their word filter and how
+// many of them it ruled out without computing their distance
+struct filter_stats {
+  std::size_t checked = 0;
+  std::size_t rejected = 0;
+};
+
+} // namespace qs
+
+#endif // QS_WORD_FILTER_HPP
@@ -0,0 +1,135 @@
+#ifndef QS_WORK_STEALING_DEQUE_HPP
+#define QS_WORK_STEALING_DEQUE_HPP
+
+#include <atomic>
+#include <type_traits>
+
+#include <qs/core.h>
+#include <qs/vector.hpp>
+
+namespace qs {
+
+// A Chase-Lev work stealing deque (with the memory orderings of Lê et al.,
+// "Correct and Efficient Work-Stealing for Weak Memory Models").
+//
+// Only the owner thread may push and pop from the bottom. Any thread may steal
+// from the top. The buffer grows when it is full; old buffers are kept until
+// the deque is destroyed since a thief may still be reading from them.
+template <typename T> class work_stealing_deque {
+  static_assert(std::is_trivially_copyable<T>::value,
+                "work_stealing_deque only holds trivially copyable items");
+
+  struct ring {
+    i64 capacity;
+    i64 mask;
+    std::atomic<T> *items;
+
+    explicit ring(i64 capacity)
+        : capacity(capacity), mask(capacity - 1),
+          items(new std::atomic<T>[capacity]) {}
+    ~ring() { delete[] items; }
+
+    T get(i64 i) const {
+      return items[i & mask].load(std::memory_order_relaxed);
+    }
+    void put(i64 i, T item) {
+      items[i & mask].store(item, std::memory_order_relaxed);
+    }
+
+    ring *grow(i64 bottom, i64 top) const {
+      auto bigger = new ring(capacity * 2);
+      for (i64 i = top; i != bottom; i++) {
+        bigger->put(i, get(i));
+      }
+      return bigger;
+    }
+  };
+
+  alignas(QS_CACHE_LINE_SIZE) std::atomic<i64> top;
+  alignas(QS_CACHE_LINE_SIZE) std::atomic<i64> bottom;
+  alignas(QS_CACHE_LINE_SIZE) std::atomic<ring *> buffer;
+  qs::vector<ring *> retired;
+
+public:
+  // capacity must be a power of two
+  explicit work_stealing_deque(i64 capacity = 1024)
+      : top(0), bottom(0), buffer(new ring(capacity)), retired{4} {}
+
+  work_stealing_deque(const work_stealing_deque &other) = delete;
+  work_stealing_deque &operator=(const work_stealing_deque &other) = delete;
+
+  ~work_stealing_deque() {
+    delete buffer.load(std::memory_order_relaxed);
+    for (auto r : retired) {
+      delete r;
+    }
+  }
+
+  // Owner only
+  void push(T item) {
+    i64 b = bottom.load(std::memory_order_relaxed);
+    i64 t = top.load(std::memory_order_acquire);
+    ring *r = buffer.load(std::memory_order_relaxed);
+    if (b - t > r->capacity - 1) {
+      retired.push(r);
+      r = r->grow(b, t);
+      buffer.store(r, std::memory_order_release);
+    }
+    r->put(b, item);
+    std::atomic_thread_fence(std::memory_order_release);
+    bottom.store(b + 1, std::memory_order_relaxed);
+  }
+
+  // Owner only. Returns false if the deque is empty
+  bool pop(T &out) {
+    i64 b = bottom.load(std::memory_order_relaxed) - 1;
+    ring *r = buffer.load(std::memory_order_relaxed);
+    bottom.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    i64 t = top.load(std::memory_order_relaxed);
+    if (t > b) {
+      bottom.store(b + 1, std::memory_order_relaxed);
+      return false;
+    }
+    out = r->get(b);
+    if (t == b) {
+      // Last item, race against the thieves for it
+      bool won = top.compare_exchange_strong(t, t + 1,
+                                             std::memory_order_seq_cst,
+                                             std::memory_order_relaxed);
+      bottom.store(b + 1, std::memory_order_relaxed);
+      return won;
+    }
+    return true;
+  }
+
+  // Any thread. Returns false if the deque is empty or another thread won the
+  // race for the top item
+  bool steal(T &out) {
+    i64 t = top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    i64 b = bottom.load(std::memory_order_acquire);
+    if (t >= b) {
+      return false;
+    }
+    ring *r = buffer.load(std::memory_order_acquire);
+    T item = r->get(t);
+    if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                     std::memory_order_relaxed)) {
+      return false;
+    }
+    out = item;
+    return true;
+  }
+
+  // Approximate when called concurrently with push/pop/steal
+  i64 size() const {
+    i64 b = bottom.load(std::memory_order_relaxed);
+    i64 t = top.load(std::memory_order_relaxed);
+    return b > t ? b - t : 0;
+  }
+};
+
+} // namespace qs
+
+#endif // QS_WORK_STEALING_DEQUE_HPP
@@ -0,0 +1,132 @@
+#ifndef QS_WORK_STEALING_SCHEDULER_HPP
+#define QS_WORK_STEALING_SCHEDULER_HPP
+
+#include <atomic>
+#include <pthread.h>
+
+#include <qs/core.h>
+#include <qs/job.h>
+#include <qs/queue.hpp>
+#include <qs/scheduler.hpp>
+#include <qs/vector.hpp>
+#include <qs/work_stealing_deque.hpp>
+
+namespace qs {
+
+#define QS_INJECTOR_CAPACITY 4096
+
+struct scheduler_stats {
+  u64 executed;
+  u64 steals;
+  u64 failed_steals;
+  i64 queue_depth;
+};
+
+// A scheduler with the same interface as qs::scheduler where every worker owns
+// a work stealing deque. Jobs submitted by a worker go to its own deque, jobs
+// submitted from other threads go to a shared injection queue and a worker
+// that runs out of work steals from the top of the deques of the others. A
+// long job therefore only blocks the worker that runs it.
+class work_stealing_scheduler {
+  struct alignas(QS_CACHE_LINE_SIZE) worker_state {
+    work_stealing_deque<job *> deque;
+    work_stealing_scheduler *sched = nullptr;
+    std::size_t index = 0;
+    u64 rng = 0;
+    std::atomic<u64> executed{0};
+    std::atomic<u64> steals{0};
+    std::atomic<u64> failed_steals{0};
+  };
+
+  qs::vector<pthread_t> thread_pool;
+  worker_state *workers;
+  std::size_t workers_count;
+  std::size_t spin_budget;
+
+  // Jobs submitted from outside the pool go to a lock free ring. The mutex
+  // guarded overflow list only takes jobs while the ring is full so
+  // submit_job never blocks
+  mpmc_queue<job *> injector{QS_INJECTOR_CAPACITY};
+  pthread_mutex_t overflow_mutex = PTHREAD_MUTEX_INITIALIZER;
+  queue<job *> overflow;
+  std::atomic<i64> overflow_size{0};
+  std::atomic<i64> injector_size{0};
+
+  // Jobs that are waiting in a deque or in the injection queue
+  std::atomic<i64> queued{0};
+  // Jobs that have been submitted but have not finished running
+  std::atomic<i64> unfinished{0};
+  std::atomic<std::size_t> sleepers{0};
+  std::atomic<bool> stopping{false};
+  pthread_mutex_t sleep_mutex = PTHREAD_MUTEX_INITIALIZER;
+  pthread_cond_t work_available = PTHREAD_COND_INITIALIZER;
+  pthread_cond_t all_done = PTHREAD_COND_INITIALIZER;
+
+  static thread_local worker_state *current_worker;
+
+  friend class task_group;
+
+  static void *start_worker(worker_state *w);
+  void run(worker_state *w);
+  void execute(worker_state *w, job *j);
+  bool run_pending_job();
+  job *find_job(worker_state *w);
+  job *steal_job(worker_state *w);
+  void wake_worker();
+
+public:
+  work_stealing_scheduler() = delete;
+  explicit work_stealing_scheduler(
+      std::size_t threads_count,
+      std::size_t spin_budget = QS_DEFAULT_SPIN_BUDGET);
+  work_stealing_scheduler(const work_stealing_scheduler &other) = delete;
+  work_stealing_scheduler &
+  operator=(const work_stealing_scheduler &other) = delete;
+
+  // Runs the jobs that are still queued and joins the workers
+  ~work_stealing_scheduler();
+
+  void submit_job(job *j);
+
+  // Blocks until every submitted job has finished. Must not be called from
+  // inside a job of the same scheduler
+  void wait_all_finish();
+
+  std::size_t get_workers_count() const { return workers_count; }
+
+  // Per worker counters. They are read without stopping the workers so they
+  // are only approximate while jobs are running
+  scheduler_stats get_stats(std::size_t worker) const;
+  i64 get_injector_depth() const { return injector_size.load(); }
+  // Jobs that are queued or running, approximate like the stats
+  std::size_t get_pending_jobs() const {
+    i64 n = unfinished.load(std::memory_order_relaxed);
+    return n > 0 ? (std::size_t)n : 0;
+  }
+};
+
+// Fork-join on top of a work_stealing_scheduler. Jobs spawned through the group
+// are regular jobs of the scheduler. wait() returns once all of them have
+// finished; if it is called from a worker of the scheduler the worker keeps
+// running queued jobs in the meantime instead of blocking, so a job can fan
+// out to the pool it is running on without starving it.
+class task_group {
+  friend class work_stealing_scheduler;
+
+  work_stealing_scheduler &sched;
+  std::atomic<i64> pending{0};
+
+public:
+  explicit task_group(work_stealing_scheduler &sched) : sched(sched) {}
+  task_group(const task_group &other) = delete;
+  task_group &operator=(const task_group &other) = delete;
+
+  ~task_group() { wait(); }
+
+  void spawn(job *j);
+  void wait();
+};
+
+} // namespace qs
+
+#endif // QS_WORK_STEALING_SCHEDULER_HPP
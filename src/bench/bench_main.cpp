@@ -0,0 +1,117 @@
+#define CATCH_CONFIG_MAIN
+#include "../test/catch_amalgamated.hpp"
+
+#include <string>
+#include <vector>
+
+// Machine readable reporters so the results can be kept and compared over
+// time, e.g. ./build/benchmarks -r csv -o results.csv. They print one row per
+// benchmark and nothing about the assertions
+
+namespace {
+
+struct bench_row {
+  std::string test_case;
+  std::string name;
+  int samples;
+  int iterations;
+  double mean_ns;
+  double mean_lower_ns;
+  double mean_upper_ns;
+  double std_dev_ns;
+};
+
+template <typename Derived>
+struct bench_reporter : Catch::StreamingReporterBase<Derived> {
+  using Catch::StreamingReporterBase<Derived>::StreamingReporterBase;
+
+  void assertionStarting(Catch::AssertionInfo const &) override {}
+  bool assertionEnded(Catch::AssertionStats const &) override { return true; }
+
+  void benchmarkEnded(Catch::BenchmarkStats<> const &stats) override {
+    std::string test_case;
+    if (this->currentTestCaseInfo) {
+      test_case = this->currentTestCaseInfo->name;
+    }
+    static_cast<Derived *>(this)->row(bench_row{
+        test_case, stats.info.name, stats.info.samples, stats.info.iterations,
+        stats.mean.point.count(), stats.mean.lower_bound.count(),
+        stats.mean.upper_bound.count(), stats.standardDeviation.point.count()});
+  }
+};
+
+struct csv_reporter : bench_reporter<csv_reporter> {
+  using bench_reporter::bench_reporter;
+
+  static std::string getDescription() {
+    return "One CSV row per benchmark, times in nanoseconds";
+  }
+
+  static std::string quote(const std::string &s) {
+    std::string ret = "\"";
+    for (char c : s) {
+      if (c == '"') {
+        ret += '"';
+      }
+      ret += c;
+    }
+    return ret + '"';
+  }
+
+  void testRunStarting(Catch::TestRunInfo const &info) override {
+    bench_reporter::testRunStarting(info);
+    stream << "test_case,benchmark,samples,iterations,mean_ns,mean_lower_ns,"
+              "mean_upper_ns,std_dev_ns\n";
+  }
+
+  void row(const bench_row &r) {
+    stream << quote(r.test_case) << ',' << quote(r.name) << ',' << r.samples
+           << ',' << r.iterations << ',' << r.mean_ns << ',' << r.mean_lower_ns
+           << ',' << r.mean_upper_ns << ',' << r.std_dev_ns << '\n';
+  }
+};
+
+struct json_reporter : bench_reporter<json_reporter> {
+  using bench_reporter::bench_reporter;
+
+  std::vector<bench_row> rows;
+
+  static std::string getDescription() {
+    return "An array with one object per benchmark, times in nanoseconds";
+  }
+
+  static std::string quote(const std::string &s) {
+    std::string ret = "\"";
+    for (char c : s) {
+      if (c == '"' || c == '\\') {
+        ret += '\\';
+      }
+      ret += c;
+    }
+    return ret + '"';
+  }
+
+  void row(const bench_row &r) { rows.push_back(r); }
+
+  void testRunEnded(Catch::TestRunStats const &stats) override {
+    bench_reporter::testRunEnded(stats);
+    stream << "[";
+    for (std::size_t i = 0; i < rows.size(); i++) {
+      auto &r = rows[i];
+      stream << (i == 0 ? "\n" : ",\n") << "  {\"test_case\": "
+             << quote(r.test_case) << ", \"benchmark\": " << quote(r.name)
+             << ", \"samples\": " << r.samples
+             << ", \"iterations\": " << r.iterations
+             << ", \"mean_ns\": " << r.mean_ns
+             << ", \"mean_lower_ns\": " << r.mean_lower_ns
+             << ", \"mean_upper_ns\": " << r.mean_upper_ns
+             << ", \"std_dev_ns\": " << r.std_dev_ns << "}";
+    }
+    stream << "\n]\n";
+  }
+};
+
+} // namespace
+
+CATCH_REGISTER_REPORTER("csv", csv_reporter)
+CATCH_REGISTER_REPORTER("json", json_reporter)
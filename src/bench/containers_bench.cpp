@@ -0,0 +1,552 @@
+#include "../test/catch_amalgamated.hpp"
+
+#include <qs/bk_tree.hpp>
+#include <qs/core.h>
+#include <qs/distances.hpp>
+#include <qs/flat_bk_tree.hpp>
+#include <qs/flat_scan.hpp>
+#include <qs/hash_table.hpp>
+#include <qs/list.hpp>
+#include <qs/queue.hpp>
+#include <qs/skip_list.hpp>
+#include <qs/string_view.h>
+#include <qs/vector.hpp>
+
+#include <list>
+#include <queue>
+#include <set>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Every qs container next to its std:: counterpart, at a size that fits in
+// the caches and one that does not. The string keys go through the word hash
+// of qs::string_view
+#define BENCH_SMALL 1024
+#define BENCH_LARGE 65536
+// The trees and the skip list are much slower so they get smaller sizes
+#define BENCH_SLOW_SMALL 1024
+#define BENCH_SLOW_LARGE 16384
+#define BENCH_TREE_QUERIES 64
+
+// Distinct keys in a scattered order, the multiplier is odd so no two
+// indices map to the same key
+static std::vector<u32> bench_keys(std::size_t n) {
+  std::vector<u32> keys(n);
+  for (std::size_t i = 0; i < n; i++) {
+    keys[i] = (u32)(i + 1) * 2654435761u;
+  }
+  return keys;
+}
+
+// Random lowercase words of 4 to 15 letters
+static std::vector<std::string> bench_words(std::size_t n) {
+  std::vector<std::string> words(n);
+  u64 state = 42;
+  for (auto &w : words) {
+    state = state * 6364136223846793005ull + 1442695040888963407ull;
+    std::size_t length = 4 + (state >> 33) % 12;
+    for (std::size_t c = 0; c < length; c++) {
+      state = state * 6364136223846793005ull + 1442695040888963407ull;
+      w += (char)('a' + (state >> 33) % 26);
+    }
+  }
+  return words;
+}
+
+static std::vector<qs::string_view> bench_views(std::vector<std::string> &w) {
+  std::vector<qs::string_view> views;
+  for (auto &s : w) {
+    views.push_back(qs::string_view(s.data(), s.data() + s.size() - 1));
+  }
+  return views;
+}
+
+static std::string sized(const char *name, std::size_t n) {
+  return std::string(name) + " " + std::to_string(n);
+}
+
+TEST_CASE("hash tables with integer keys", "[containers]") {
+  for (std::size_t n : {BENCH_SMALL, BENCH_LARGE}) {
+    auto keys = bench_keys(n);
+    qs::hash_table<u32, u32> qs_table{};
+    std::unordered_map<u32, u32> std_table{};
+    for (auto k : keys) {
+      qs_table.insert(k, k);
+      std_table.emplace(k, k);
+    }
+
+    BENCHMARK(sized("qs::hash_table insert", n)) {
+      qs::hash_table<u32, u32> t{};
+      for (auto k : keys) {
+        t.insert(k, k);
+      }
+      return t.get_size();
+    };
+    BENCHMARK(sized("std::unordered_map insert", n)) {
+      std::unordered_map<u32, u32> t{};
+      for (auto k : keys) {
+        t.emplace(k, k);
+      }
+      return t.size();
+    };
+    BENCHMARK(sized("qs::hash_table lookup", n)) {
+      u64 sum = 0;
+      for (auto k : keys) {
+        sum += *qs_table.lookup(k);
+      }
+      return sum;
+    };
+    BENCHMARK(sized("std::unordered_map lookup", n)) {
+      u64 sum = 0;
+      for (auto k : keys) {
+        sum += std_table.find(k)->second;
+      }
+      return sum;
+    };
+    BENCHMARK(sized("qs::hash_table iterate", n)) {
+      u64 sum = 0;
+      for (auto iter = qs_table.begin(); iter != qs_table.end(); ++iter) {
+        sum += *iter;
+      }
+      return sum;
+    };
+    BENCHMARK(sized("std::unordered_map iterate", n)) {
+      u64 sum = 0;
+      for (auto &kv : std_table) {
+        sum += kv.second;
+      }
+      return sum;
+    };
+    BENCHMARK_ADVANCED(sized("qs::hash_table remove", n))
+    (Catch::Benchmark::Chronometer meter) {
+      std::vector<qs::hash_table<u32, u32>> tables;
+      for (int r = 0; r < meter.runs(); r++) {
+        tables.emplace_back();
+        for (auto k : keys) {
+          tables.back().insert(k, k);
+        }
+      }
+      meter.measure([&](int r) {
+        for (auto k : keys) {
+          tables[r].remove(k);
+        }
+        return tables[r].get_size();
+      });
+    };
+    BENCHMARK_ADVANCED(sized("std::unordered_map remove", n))
+    (Catch::Benchmark::Chronometer meter) {
+      std::vector<std::unordered_map<u32, u32>> tables(meter.runs(),
+                                                       std_table);
+      meter.measure([&](int r) {
+        for (auto k : keys) {
+          tables[r].erase(k);
+        }
+        return tables[r].size();
+      });
+    };
+  }
+}
+
+TEST_CASE("hash tables with string keys", "[containers]") {
+  for (std::size_t n : {BENCH_SMALL, BENCH_LARGE}) {
+    auto words = bench_words(n);
+    auto views = bench_views(words);
+    qs::hash_table<qs::string_view, u32> qs_table{};
+    std::unordered_map<std::string_view, u32> std_table{};
+    for (u32 i = 0; i < n; i++) {
+      qs_table.insert(views[i], i);
+      std_table.emplace(words[i], i);
+    }
+
+    BENCHMARK(sized("qs::hash_table insert", n)) {
+      qs::hash_table<qs::string_view, u32> t{};
+      for (u32 i = 0; i < n; i++) {
+        t.insert(views[i], i);
+      }
+      return t.get_size();
+    };
+    BENCHMARK(sized("std::unordered_map insert", n)) {
+      std::unordered_map<std::string_view, u32> t{};
+      for (u32 i = 0; i < n; i++) {
+        t.emplace(words[i], i);
+      }
+      return t.size();
+    };
+    BENCHMARK(sized("qs::hash_table lookup", n)) {
+      u64 sum = 0;
+      for (auto &v : views) {
+        sum += *qs_table.lookup(v);
+      }
+      return sum;
+    };
+    BENCHMARK(sized("std::unordered_map lookup", n)) {
+      u64 sum = 0;
+      for (auto &w : words) {
+        sum += std_table.find(w)->second;
+      }
+      return sum;
+    };
+    BENCHMARK(sized("qs::hash_table iterate", n)) {
+      u64 sum = 0;
+      for (auto iter = qs_table.begin(); iter != qs_table.end(); ++iter) {
+        sum += iter.key().size();
+      }
+      return sum;
+    };
+    BENCHMARK(sized("std::unordered_map iterate", n)) {
+      u64 sum = 0;
+      for (auto &kv : std_table) {
+        sum += kv.first.size();
+      }
+      return sum;
+    };
+    BENCHMARK_ADVANCED(sized("qs::hash_table remove", n))
+    (Catch::Benchmark::Chronometer meter) {
+      std::vector<qs::hash_table<qs::string_view, u32>> tables;
+      for (int r = 0; r < meter.runs(); r++) {
+        tables.emplace_back();
+        for (u32 i = 0; i < n; i++) {
+          tables.back().insert(views[i], i);
+        }
+      }
+      meter.measure([&](int r) {
+        for (auto &v : views) {
+          tables[r].remove(v);
+        }
+        return tables[r].get_size();
+      });
+    };
+    BENCHMARK_ADVANCED(sized("std::unordered_map remove", n))
+    (Catch::Benchmark::Chronometer meter) {
+      std::vector<std::unordered_map<std::string_view, u32>> tables(
+          meter.runs(), std_table);
+      meter.measure([&](int r) {
+        for (auto &w : words) {
+          tables[r].erase(w);
+        }
+        return tables[r].size();
+      });
+    };
+  }
+}
+
+TEST_CASE("vectors", "[containers]") {
+  for (std::size_t n : {BENCH_SMALL, BENCH_LARGE}) {
+    auto keys = bench_keys(n);
+    qs::vector<u32> qs_vector{};
+    std::vector<u32> std_vector{};
+    for (auto k : keys) {
+      qs_vector.push(k);
+      std_vector.push_back(k);
+    }
+
+    BENCHMARK(sized("qs::vector push", n)) {
+      qs::vector<u32> v{};
+      for (auto k : keys) {
+        v.push(k);
+      }
+      return v.get_size();
+    };
+    BENCHMARK(sized("std::vector push_back", n)) {
+      std::vector<u32> v{};
+      for (auto k : keys) {
+        v.push_back(k);
+      }
+      return v.size();
+    };
+    BENCHMARK(sized("qs::vector iterate", n)) {
+      u64 sum = 0;
+      for (auto k : qs_vector) {
+        sum += k;
+      }
+      return sum;
+    };
+    BENCHMARK(sized("std::vector iterate", n)) {
+      u64 sum = 0;
+      for (auto k : std_vector) {
+        sum += k;
+      }
+      return sum;
+    };
+    BENCHMARK_ADVANCED(sized("qs::vector pop", n))
+    (Catch::Benchmark::Chronometer meter) {
+      std::vector<qs::vector<u32>> vectors(meter.runs(), qs_vector);
+      meter.measure([&](int r) {
+        u64 sum = 0;
+        while (vectors[r].get_size() > 0) {
+          sum += vectors[r].pop();
+        }
+        return sum;
+      });
+    };
+    BENCHMARK_ADVANCED(sized("std::vector pop_back", n))
+    (Catch::Benchmark::Chronometer meter) {
+      std::vector<std::vector<u32>> vectors(meter.runs(), std_vector);
+      meter.measure([&](int r) {
+        u64 sum = 0;
+        while (!vectors[r].empty()) {
+          sum += vectors[r].back();
+          vectors[r].pop_back();
+        }
+        return sum;
+      });
+    };
+  }
+}
+
+TEST_CASE("linked lists", "[containers]") {
+  for (std::size_t n : {BENCH_SMALL, BENCH_LARGE}) {
+    auto keys = bench_keys(n);
+    qs::linked_list<u32> qs_list{};
+    std::list<u32> std_list{};
+    for (auto k : keys) {
+      qs_list.append(k);
+      std_list.push_back(k);
+    }
+
+    BENCHMARK(sized("qs::linked_list append", n)) {
+      qs::linked_list<u32> l{};
+      for (auto k : keys) {
+        l.append(k);
+      }
+      return l.get_size();
+    };
+    BENCHMARK(sized("std::list push_back", n)) {
+      std::list<u32> l{};
+      for (auto k : keys) {
+        l.push_back(k);
+      }
+      return l.size();
+    };
+    BENCHMARK(sized("qs::linked_list iterate", n)) {
+      u64 sum = 0;
+      for (auto k : qs_list) {
+        sum += k;
+      }
+      return sum;
+    };
+    BENCHMARK(sized("std::list iterate", n)) {
+      u64 sum = 0;
+      for (auto k : std_list) {
+        sum += k;
+      }
+      return sum;
+    };
+    BENCHMARK_ADVANCED(sized("qs::linked_list remove", n))
+    (Catch::Benchmark::Chronometer meter) {
+      // qs::linked_list can not be copied
+      std::vector<qs::linked_list<u32>> lists(meter.runs());
+      for (auto &l : lists) {
+        for (auto k : keys) {
+          l.append(k);
+        }
+      }
+      meter.measure([&](int r) {
+        while (lists[r].head != nullptr) {
+          lists[r].remove(lists[r].head);
+        }
+        return lists[r].get_size();
+      });
+    };
+    BENCHMARK_ADVANCED(sized("std::list remove", n))
+    (Catch::Benchmark::Chronometer meter) {
+      std::vector<std::list<u32>> lists(meter.runs(), std_list);
+      meter.measure([&](int r) {
+        while (!lists[r].empty()) {
+          lists[r].pop_front();
+        }
+        return lists[r].size();
+      });
+    };
+  }
+}
+
+TEST_CASE("skip lists", "[containers]") {
+  auto cmp = [](const u32 &a, const u32 &b) { return a < b ? -1 : a > b; };
+  for (std::size_t n : {BENCH_SLOW_SMALL, BENCH_SLOW_LARGE}) {
+    auto keys = bench_keys(n);
+    qs::skip_list<u32, 16> qs_list{cmp};
+    std::set<u32> std_set{};
+    for (auto k : keys) {
+      qs_list.insert(k);
+      std_set.insert(k);
+    }
+
+    BENCHMARK(sized("qs::skip_list insert", n)) {
+      qs::skip_list<u32, 16> l{cmp};
+      for (auto k : keys) {
+        l.insert(k);
+      }
+      return l.get_size();
+    };
+    BENCHMARK(sized("std::set insert", n)) {
+      std::set<u32> s{};
+      for (auto k : keys) {
+        s.insert(k);
+      }
+      return s.size();
+    };
+    BENCHMARK(sized("qs::skip_list find", n)) {
+      u64 sum = 0;
+      for (auto k : keys) {
+        sum += *qs_list.find(k);
+      }
+      return sum;
+    };
+    BENCHMARK(sized("std::set find", n)) {
+      u64 sum = 0;
+      for (auto k : keys) {
+        sum += *std_set.find(k);
+      }
+      return sum;
+    };
+    BENCHMARK(sized("qs::skip_list iterate", n)) {
+      u64 sum = 0;
+      for (auto k : qs_list) {
+        sum += k;
+      }
+      return sum;
+    };
+    BENCHMARK(sized("std::set iterate", n)) {
+      u64 sum = 0;
+      for (auto k : std_set) {
+        sum += k;
+      }
+      return sum;
+    };
+    BENCHMARK_ADVANCED(sized("qs::skip_list remove", n))
+    (Catch::Benchmark::Chronometer meter) {
+      std::vector<qs::skip_list<u32, 16>> lists(meter.runs(), qs_list);
+      meter.measure([&](int r) {
+        for (auto k : keys) {
+          lists[r].remove(k);
+        }
+        return lists[r].get_size();
+      });
+    };
+    BENCHMARK_ADVANCED(sized("std::set remove", n))
+    (Catch::Benchmark::Chronometer meter) {
+      std::vector<std::set<u32>> sets(meter.runs(), std_set);
+      meter.measure([&](int r) {
+        for (auto k : keys) {
+          sets[r].erase(k);
+        }
+        return sets[r].size();
+      });
+    };
+  }
+}
+
+// There is no std:: tree for metric spaces, so the trees are compared against
+// a scan of every word
+TEST_CASE("bk trees", "[containers]") {
+  for (std::size_t n : {BENCH_SLOW_SMALL, BENCH_SLOW_LARGE}) {
+    auto words = bench_words(n);
+    auto views = bench_views(words);
+    qs::bk_tree<qs::string_view> tree{&qs::edit_distance};
+    for (auto &v : views) {
+      tree.insert(v);
+    }
+    qs::flat_bk_tree<qs::string_view> flat{tree};
+    qs::flat_scan<qs::string_view> scan{tree};
+    auto queries = bench_words(BENCH_TREE_QUERIES * 2);
+    auto query_views = bench_views(queries);
+    query_views.erase(query_views.begin(),
+                      query_views.begin() + BENCH_TREE_QUERIES);
+
+    BENCHMARK(sized("qs::bk_tree insert", n)) {
+      qs::bk_tree<qs::string_view> t{&qs::edit_distance};
+      for (auto &v : views) {
+        t.insert(v);
+      }
+      return t.get_size();
+    };
+    BENCHMARK(sized("qs::bk_tree match", n)) {
+      std::size_t found = 0;
+      for (auto &q : query_views) {
+        found += tree.match(2, q).get_size();
+      }
+      return found;
+    };
+    BENCHMARK(sized("qs::flat_bk_tree match", n)) {
+      std::size_t found = 0;
+      for (auto &q : query_views) {
+        found += flat.match(2, q).get_size();
+      }
+      return found;
+    };
+    BENCHMARK(sized("qs::flat_scan match", n)) {
+      std::size_t found = 0;
+      for (auto &q : query_views) {
+        found += scan.match(2, q).get_size();
+      }
+      return found;
+    };
+    BENCHMARK(sized("std::vector scan", n)) {
+      std::size_t found = 0;
+      for (auto &q : query_views) {
+        for (auto &v : views) {
+          found += qs::edit_distance(v, q) <= 2;
+        }
+      }
+      return found;
+    };
+    BENCHMARK_ADVANCED(sized("qs::bk_tree remove", n))
+    (Catch::Benchmark::Chronometer meter) {
+      std::vector<qs::bk_tree<qs::string_view>> trees;
+      for (int r = 0; r < meter.runs(); r++) {
+        trees.emplace_back(views, &qs::edit_distance);
+      }
+      meter.measure([&](int r) {
+        for (auto &v : views) {
+          trees[r].remove(v);
+        }
+        trees[r].compact();
+        return trees[r].get_size();
+      });
+    };
+  }
+}
+
+TEST_CASE("queues", "[containers]") {
+  for (std::size_t n : {BENCH_SMALL, BENCH_LARGE}) {
+    auto keys = bench_keys(n);
+
+    BENCHMARK(sized("qs::queue enqueue and dequeue", n)) {
+      qs::queue<u32> q{};
+      for (auto k : keys) {
+        q.enqueue(k);
+      }
+      u64 sum = 0;
+      while (!q.empty()) {
+        sum += q.dequeue().get();
+      }
+      return sum;
+    };
+    BENCHMARK(sized("qs::concurrent_queue enqueue and dequeue", n)) {
+      qs::concurrent_queue<u32> q{};
+      for (auto k : keys) {
+        q.enqueue(k);
+      }
+      u64 sum = 0;
+      for (std::size_t i = 0; i < n; i++) {
+        sum += q.dequeue(nullptr).get();
+      }
+      return sum;
+    };
+    BENCHMARK(sized("std::queue push and pop", n)) {
+      std::queue<u32> q{};
+      for (auto k : keys) {
+        q.push(k);
+      }
+      u64 sum = 0;
+      while (!q.empty()) {
+        sum += q.front();
+        q.pop();
+      }
+      return sum;
+    };
+  }
+}
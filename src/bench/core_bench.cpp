@@ -0,0 +1,446 @@
+// Drives the core API with a synthetic, deterministic workload and reports the
+// throughput, the MatchDocument -> result latency and the peak RSS. The same
+// options and seed always produce the same queries and documents, so two
+// builds can be compared run against run. The results checksum changes if the
+// answers do.
+//
+//   ./build/bench --docs=20000 --queries=5000 --zipf=1.1 --churn=0.1
+//
+// Every option is --name=value, see bench_config for the list. --verify=1
+// also checks every answer against a brute force matcher, which is slow, so
+// keep the workload small.
+#include <core.h>
+#include <qs/core.h>
+#include <qs/distances.hpp>
+#include <qs/hash_set.hpp>
+#include <qs/hash_table.hpp>
+#include <qs/parser.hpp>
+#include <qs/string_view.h>
+#include <qs/vector.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string_view>
+#include <sys/resource.h>
+
+struct bench_config {
+  u64 seed = 42;
+  // Queries active at any time
+  u32 queries = 2000;
+  u32 docs = 2000;
+  // Documents matched between two rounds of query churn
+  u32 batch = 100;
+  u32 doc_words = 100;
+  u32 vocab = 20000;
+  // Zipf exponent of the word frequencies of both queries and documents
+  double zipf = 1.0;
+  // Relative weights of the match types
+  u32 exact = 1;
+  u32 hamming = 1;
+  u32 edit = 1;
+  // Thresholds of hamming and edit queries are uniform in [0, max_dist]
+  u32 max_dist = 3;
+  // Fraction of the active queries that is ended and replaced every batch
+  double churn = 0.05;
+  u32 max_word_length = 12;
+  // Fraction of the vocabulary that is a small edit of another word, so the
+  // approximate queries have something to match
+  double variants = 0.3;
+  // Checks every answer against a brute force matcher when not 0
+  u32 verify = 0;
+  // Records the metrics of the core and prints them at the end when not 0
+  u32 metrics = 0;
+  // Hands every document over with MatchDocumentOwned when not 0
+  u32 owned = 0;
+  // The engine of the edit distance searches, bk_tree, trie or deletion.
+  // Unset keeps the default of the build, see SEARCH_EDIT_INDEX
+  const char *edit_index = nullptr;
+  // The engine of the hamming distance searches, bk_tree or partition. Unset
+  // keeps the default of the build, see SEARCH_HAMMING_INDEX
+  const char *hamming_index = nullptr;
+  // Snapshots of at most this many words are scanned. Unset keeps the default
+  // of the core, see SEARCH_SCAN_MAX_WORDS
+  const char *scan_max_words = nullptr;
+};
+
+// splitmix64, so the workload does not depend on the standard library
+struct bench_rng {
+  u64 state;
+
+  explicit bench_rng(u64 seed) : state(seed) {}
+
+  u64 next() {
+    u64 z = (state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+  }
+
+  // Uniform in [0, n)
+  u32 below(u32 n) { return (u32)(next() % n); }
+  double unit() { return (next() >> 11) * (1.0 / (1ULL << 53)); }
+};
+
+struct word {
+  char data[MAX_WORD_LENGTH + 1];
+};
+
+class workload {
+  bench_config config;
+  bench_rng rng;
+  qs::vector<word> words;
+  // Cumulative zipf weights of the words by rank
+  qs::vector<double> cdf;
+
+  void make_vocabulary() {
+    for (u32 i = 0; i < config.vocab; i++) {
+      word w{};
+      if (i > 0 && rng.unit() < config.variants) {
+        // Change one or two letters of an earlier word
+        std::memcpy(w.data, words[rng.below(i)].data, sizeof(w.data));
+        u32 length = (u32)std::strlen(w.data);
+        u32 edits = 1 + rng.below(2);
+        for (u32 e = 0; e < edits; e++) {
+          w.data[rng.below(length)] = (char)('a' + rng.below(26));
+        }
+      } else {
+        u32 span = config.max_word_length - MIN_WORD_LENGTH + 1;
+        u32 length = MIN_WORD_LENGTH + rng.below(span);
+        for (u32 c = 0; c < length; c++) {
+          w.data[c] = (char)('a' + rng.below(26));
+        }
+      }
+      words.push(w);
+    }
+    double total = 0;
+    for (u32 rank = 1; rank <= config.vocab; rank++) {
+      total += 1.0 / std::pow((double)rank, config.zipf);
+      cdf.push(total);
+    }
+    for (u32 i = 0; i < config.vocab; i++) {
+      cdf[i] /= total;
+    }
+  }
+
+public:
+  explicit workload(const bench_config &config)
+      : config(config), rng(config.seed), words{config.vocab + 2},
+        cdf{config.vocab + 2} {
+    make_vocabulary();
+  }
+
+  const char *zipf_word() {
+    double u = rng.unit();
+    auto begin = cdf.get_data();
+    auto end = begin + cdf.get_size();
+    auto rank = std::lower_bound(begin, end, u) - begin;
+    if (rank == (long)cdf.get_size()) {
+      rank--;
+    }
+    return words[rank].data;
+  }
+
+  // Writes space separated words to out, which must fit them
+  void fill(char *out, u32 count) {
+    char *p = out;
+    for (u32 i = 0; i < count; i++) {
+      const char *w = zipf_word();
+      std::size_t length = std::strlen(w);
+      std::memcpy(p, w, length);
+      p += length;
+      *p++ = ' ';
+    }
+    *(p > out ? p - 1 : p) = '\0';
+  }
+
+  void next_query(char *out, MatchType *type, u32 *dist) {
+    u32 total = config.exact + config.hamming + config.edit;
+    u32 pick = rng.below(total);
+    if (pick < config.exact) {
+      *type = MT_EXACT_MATCH;
+      *dist = 0;
+    } else {
+      *type = pick < config.exact + config.hamming ? MT_HAMMING_DIST
+                                                   : MT_EDIT_DIST;
+      *dist = rng.below(config.max_dist + 1);
+    }
+    fill(out, 1 + rng.below(MAX_QUERY_WORDS));
+  }
+
+  void next_document(char *out) {
+    // Lengths vary by +-50% around doc_words
+    u32 count = config.doc_words / 2 + rng.below(config.doc_words + 1);
+    fill(out, count > 0 ? count : 1);
+  }
+
+  u32 below(u32 n) { return rng.below(n); }
+};
+
+// Matches documents against every active query the slow way, for --verify
+class reference_matcher {
+  struct query {
+    MatchType type;
+    u32 dist;
+    qs::vector<word> words;
+  };
+  qs::hash_table<QueryID, query> queries{1024};
+
+  static bool has_word(const query &q, qs::string_view w,
+                       qs::hash_set<qs::string_view> &doc) {
+    if (q.type == MT_EXACT_MATCH) {
+      return doc.contains(w);
+    }
+    for (auto &d : doc) {
+      int dist;
+      if (q.type == MT_HAMMING_DIST) {
+        if (d.size() != w.size()) {
+          continue;
+        }
+        dist = qs::hamming_distance(d, w);
+      } else {
+        dist = qs::edit_distance(d, w);
+      }
+      if (dist <= (int)q.dist) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+public:
+  void start(QueryID id, const char *text, MatchType type, u32 dist) {
+    query q{type, dist, qs::vector<word>{MAX_QUERY_WORDS + 1}};
+    qs::parse_string(text, ' ', [&q](qs::string_view &w) {
+      word copy{};
+      std::memcpy(copy.data, w.data(), w.size());
+      q.words.push(copy);
+    });
+    queries.insert(id, std::move(q));
+  }
+
+  void end(QueryID id) { queries.remove(id); }
+
+  // The sorted IDs of the queries that match text
+  void match(const char *text, qs::vector<QueryID> *out) {
+    qs::hash_set<qs::string_view> doc{1024};
+    qs::parse_string(text, ' ', [&doc](qs::string_view &w) { doc.insert(w); });
+    for (auto iter = queries.begin(); iter != queries.end(); ++iter) {
+      bool matched = true;
+      for (auto &w : iter->words) {
+        if (!has_word(*iter, qs::string_view(w.data), doc)) {
+          matched = false;
+          break;
+        }
+      }
+      if (matched) {
+        out->push(iter.key());
+      }
+    }
+    auto ids = out->get_data();
+    std::sort(ids, ids + out->get_size());
+  }
+};
+
+using bench_clock = std::chrono::steady_clock;
+
+static double elapsed_us(bench_clock::time_point from, bench_clock::time_point to) {
+  return std::chrono::duration<double, std::micro>(to - from).count();
+}
+
+static bool parse_option(const char *arg, bench_config *config) {
+  const char *eq = std::strchr(arg, '=');
+  if (std::strncmp(arg, "--", 2) != 0 || eq == nullptr) {
+    return false;
+  }
+  std::string_view name{arg + 2, (std::size_t)(eq - arg - 2)};
+  const char *value = eq + 1;
+#define BENCH_OPTION(field, parse)                                             \
+  if (name == #field) {                                                        \
+    config->field = parse;                                                     \
+    return true;                                                               \
+  }
+  BENCH_OPTION(seed, std::strtoull(value, nullptr, 10))
+  BENCH_OPTION(queries, (u32)std::atoi(value))
+  BENCH_OPTION(docs, (u32)std::atoi(value))
+  BENCH_OPTION(batch, (u32)std::atoi(value))
+  BENCH_OPTION(doc_words, (u32)std::atoi(value))
+  BENCH_OPTION(vocab, (u32)std::atoi(value))
+  BENCH_OPTION(zipf, std::atof(value))
+  BENCH_OPTION(exact, (u32)std::atoi(value))
+  BENCH_OPTION(hamming, (u32)std::atoi(value))
+  BENCH_OPTION(edit, (u32)std::atoi(value))
+  BENCH_OPTION(max_dist, (u32)std::atoi(value))
+  BENCH_OPTION(churn, std::atof(value))
+  BENCH_OPTION(max_word_length, (u32)std::atoi(value))
+  BENCH_OPTION(variants, std::atof(value))
+  BENCH_OPTION(verify, (u32)std::atoi(value))
+  BENCH_OPTION(metrics, (u32)std::atoi(value))
+  BENCH_OPTION(owned, (u32)std::atoi(value))
+  BENCH_OPTION(edit_index, value)
+  BENCH_OPTION(hamming_index, value)
+  BENCH_OPTION(scan_max_words, value)
+#undef BENCH_OPTION
+  return false;
+}
+
+static bool valid(const bench_config &c) {
+  return c.queries > 0 && c.docs > 0 && c.batch > 0 && c.doc_words > 0 &&
+         c.vocab > 0 && c.exact + c.hamming + c.edit > 0 &&
+         c.max_dist <= 3 && c.max_word_length >= MIN_WORD_LENGTH &&
+         c.max_word_length <= MAX_WORD_LENGTH &&
+         (u64)c.doc_words * 3 / 2 * (MAX_WORD_LENGTH + 1) < MAX_DOC_LENGTH;
+}
+
+int main(int argc, char *argv[]) {
+  bench_config config{};
+  for (int i = 1; i < argc; i++) {
+    if (!parse_option(argv[i], &config)) {
+      std::fprintf(stderr, "unknown option %s\n", argv[i]);
+      return 1;
+    }
+  }
+  if (!valid(config)) {
+    std::fprintf(stderr, "invalid configuration\n");
+    return 1;
+  }
+
+  workload load{config};
+  reference_matcher reference{};
+  // The expected answer of every document of the batch, for --verify
+  qs::vector<qs::vector<QueryID>> expected{config.batch + 2};
+  u64 mismatches = 0;
+  static char text[MAX_DOC_LENGTH];
+  qs::vector<QueryID> active{config.queries + 2};
+  QueryID next_query_id = 1;
+  auto start_query = [&]() {
+    MatchType type;
+    u32 dist;
+    load.next_query(text, &type, &dist);
+    if (StartQuery(next_query_id, text, type, dist) != EC_SUCCESS) {
+      std::fprintf(stderr, "StartQuery failed\n");
+      std::exit(1);
+    }
+    if (config.verify) {
+      reference.start(next_query_id, text, type, dist);
+    }
+    active.push(next_query_id++);
+  };
+
+  qs::vector<bench_clock::time_point> submitted{config.docs + 2};
+  qs::vector<double> latencies{config.docs + 2};
+  u64 results = 0;
+  u64 checksum = 0;
+
+  if (config.edit_index != nullptr) {
+    setenv("SEARCH_EDIT_INDEX", config.edit_index, 1);
+  }
+  if (config.hamming_index != nullptr) {
+    setenv("SEARCH_HAMMING_INDEX", config.hamming_index, 1);
+  }
+  if (config.scan_max_words != nullptr) {
+    setenv("SEARCH_SCAN_MAX_WORDS", config.scan_max_words, 1);
+  }
+  auto begin = bench_clock::now();
+  InitializeIndex();
+  if (config.metrics && EnableMetrics(1) != EC_SUCCESS) {
+    std::fprintf(stderr, "the core was built without metrics\n");
+  }
+  for (u32 i = 0; i < config.queries; i++) {
+    start_query();
+  }
+  for (u32 doc = 0; doc < config.docs;) {
+    if (doc > 0) {
+      u32 replaced = (u32)(active.get_size() * config.churn);
+      for (u32 i = 0; i < replaced; i++) {
+        // Swap a random query to the end and end it
+        auto data = active.get_data();
+        std::swap(data[load.below(active.get_size())],
+                  data[active.get_size() - 1]);
+        auto ended = active.pop();
+        EndQuery(ended);
+        if (config.verify) {
+          reference.end(ended);
+        }
+        start_query();
+      }
+    }
+    u32 batch_end = std::min(doc + config.batch, config.docs);
+    expected.clear();
+    for (u32 d = doc; d < batch_end; d++) {
+      load.next_document(text);
+      if (config.verify) {
+        expected.push(qs::vector<QueryID>{64});
+        reference.match(text, &expected[d - doc]);
+      }
+      submitted.push(bench_clock::now());
+      auto err = config.owned ? MatchDocumentOwned(d + 1, strdup(text))
+                              : MatchDocument(d + 1, text);
+      if (err != EC_SUCCESS) {
+        std::fprintf(stderr, "MatchDocument failed\n");
+        return 1;
+      }
+    }
+    for (u32 d = doc; d < batch_end; d++) {
+      DocID doc_id;
+      unsigned int num_res;
+      QueryID *query_ids;
+      if (GetNextAvailRes(&doc_id, &num_res, &query_ids) != EC_SUCCESS) {
+        std::fprintf(stderr, "GetNextAvailRes failed\n");
+        return 1;
+      }
+      latencies.push(elapsed_us(submitted[doc_id - 1], bench_clock::now()));
+      results += num_res;
+      // The answers are sorted but the documents finish in any order, so the
+      // hashes of the documents are added up
+      u64 hash = doc_id;
+      for (unsigned int r = 0; r < num_res; r++) {
+        hash = hash * 31 + query_ids[r];
+      }
+      checksum += bench_rng{hash}.next();
+      if (config.verify) {
+        auto &want = expected[doc_id - 1 - doc];
+        bool same = want.get_size() == num_res &&
+                    std::equal(query_ids, query_ids + num_res, want.get_data());
+        if (!same && mismatches++ < 10) {
+          std::fprintf(stderr, "document %u: %u results, expected %zu\n",
+                       doc_id, num_res, want.get_size());
+        }
+      }
+      free(query_ids);
+    }
+    doc = batch_end;
+  }
+  DestroyIndex();
+  double total_us = elapsed_us(begin, bench_clock::now());
+
+  auto lat = latencies.get_data();
+  std::sort(lat, lat + latencies.get_size());
+  auto percentile = [&](double p) {
+    auto i = (std::size_t)(p * (latencies.get_size() - 1));
+    return lat[i];
+  };
+  rusage usage{};
+  getrusage(RUSAGE_SELF, &usage);
+
+  std::printf("docs %u\n", config.docs);
+  std::printf("queries %u\n", config.queries);
+  std::printf("results %llu\n", (unsigned long long)results);
+  std::printf("results_checksum %016llx\n", (unsigned long long)checksum);
+  std::printf("elapsed_ms %.1f\n", total_us / 1e3);
+  std::printf("throughput_docs_per_s %.1f\n", config.docs / (total_us / 1e6));
+  std::printf("latency_p50_us %.1f\n", percentile(0.50));
+  std::printf("latency_p99_us %.1f\n", percentile(0.99));
+  std::printf("peak_rss_kb %ld\n", usage.ru_maxrss);
+  if (config.verify) {
+    std::printf("mismatches %llu\n", (unsigned long long)mismatches);
+  }
+  if (config.metrics) {
+    std::fflush(stdout);
+    DumpMetrics(1);
+  }
+  return mismatches > 0 ? 1 : 0;
+}
@@ -0,0 +1,113 @@
+#include "../test/catch_amalgamated.hpp"
+
+#include <qs/distances.hpp>
+#include <qs/string_view.h>
+#include <qs/vector.hpp>
+
+// Words taken from the documents of the SIGMOD test data
+static const char *bench_words[] = {
+    "abrogation", "abstract",   "action",     "advised",     "affability",
+    "against",    "aggravated", "alembert",   "allowance",   "ambassador",
+    "ambition",   "america",    "americans",  "ammunition",  "annual",
+    "annulled",   "anti",       "anything",   "apostolicum", "appeared",
+    "appears",    "april",      "arguably",   "arrested",    "assembled",
+    "assertions", "august",     "avarice",    "avignon",     "awaited",
+    "bishop",     "bishops",    "bologna",    "bourbon",     "bourgeois",
+    "cardinal",   "clement",    "clemente",   "civitavecchia",
+    "congregation"};
+
+static qs::vector<qs::string_view> bench_word_views() {
+  qs::vector<qs::string_view> ret{64};
+  for (auto w : bench_words) {
+    ret.push(qs::string_view(w));
+  }
+  return ret;
+}
+
+template <typename Fn>
+static int all_pairs(qs::vector<qs::string_view> &words, Fn f) {
+  int sum = 0;
+  for (auto &w1 : words) {
+    for (auto &w2 : words) {
+      sum += f(w1, w2);
+    }
+  }
+  return sum;
+}
+
+TEST_CASE("edit distance kernels", "[distances]") {
+  auto words = bench_word_views();
+
+  BENCHMARK("dynamic programming") {
+    return all_pairs(words, &qs::edit_distance);
+  };
+
+  BENCHMARK("bit parallel") {
+    return all_pairs(words, &qs::bit_parallel_edit_distance);
+  };
+
+  for (int max_dist = 1; max_dist <= 3; max_dist++) {
+    BENCHMARK("bounded bit parallel, max_dist = " + std::to_string(max_dist)) {
+      return all_pairs(words, [max_dist](qs::string_view s1,
+                                         qs::string_view s2) {
+        return qs::bounded_edit_distance(s1, s2, max_dist);
+      });
+    };
+  }
+}
+
+TEST_CASE("hamming distance kernels", "[distances]") {
+  auto words = bench_word_views();
+  qs::vector<qs::packed_word> packed{64};
+  for (auto &w : words) {
+    packed.push(qs::packed_word(w));
+  }
+
+  BENCHMARK("byte by byte") {
+    int sum = 0;
+    for (auto &w1 : words) {
+      for (auto &w2 : words) {
+        if (w1.size() == w2.size()) {
+          sum += qs::hamming_distance(w1, w2);
+        }
+      }
+    }
+    return sum;
+  };
+
+  BENCHMARK("packed") {
+    int sum = 0;
+    for (auto &w1 : packed) {
+      for (auto &w2 : packed) {
+        if (w1.size() == w2.size()) {
+          sum += qs::packed_hamming_distance(w1, w2);
+        }
+      }
+    }
+    return sum;
+  };
+
+  // Scoring whole blocks regardless of length, as a linear scan would
+  BENCHMARK("packed, all pairs") {
+    int sum = 0;
+    for (auto &w1 : packed) {
+      for (auto &w2 : packed) {
+        sum += qs::packed_hamming_distance(w1, w2);
+      }
+    }
+    return sum;
+  };
+
+  BENCHMARK("packed batch, all pairs") {
+    int sum = 0;
+    int out[64];
+    for (auto &w1 : packed) {
+      qs::packed_hamming_distance_batch(w1, packed.get_data(),
+                                        packed.get_size(), out);
+      for (std::size_t i = 0; i < packed.get_size(); i++) {
+        sum += out[i];
+      }
+    }
+    return sum;
+  };
+}
@@ -0,0 +1,74 @@
+#include "../test/catch_amalgamated.hpp"
+
+#include <qs/hash.h>
+#include <qs/parser.hpp>
+#include <qs/string_view.h>
+
+#include <string>
+#include <vector>
+
+// A document of random lowercase words of 1 to 15 letters, MAX_DOC_LENGTH is
+// 4MB so this is a large one
+#define BENCH_DOC_LENGTH (1 << 20)
+
+static std::string bench_document() {
+  std::string doc;
+  u64 state = 42;
+  while (doc.size() < BENCH_DOC_LENGTH) {
+    state = state * 6364136223846793005ull + 1442695040888963407ull;
+    std::size_t length = 1 + (state >> 33) % 15;
+    for (std::size_t c = 0; c < length; c++) {
+      state = state * 6364136223846793005ull + 1442695040888963407ull;
+      doc += (char)('a' + (state >> 33) % 26);
+    }
+    doc += ' ';
+  }
+  return doc;
+}
+
+TEST_CASE("document tokenizer", "[parser]") {
+  auto doc = bench_document();
+
+  BENCHMARK("qs::parse_string") {
+    std::size_t tokens = 0;
+    qs::parse_string(doc.c_str(), doc.size(), ' ',
+                     [&tokens](qs::string_view &) { tokens++; });
+    return tokens;
+  };
+
+  BENCHMARK("qs::string_view::split") {
+    std::size_t tokens = 0;
+    qs::string_view view{doc.c_str()};
+    while (view.split(' ') != qs::string_view::empty) {
+      tokens++;
+    }
+    return tokens;
+  };
+}
+
+TEST_CASE("word hashes", "[parser]") {
+  auto doc = bench_document();
+  std::vector<qs::string_view> words;
+  qs::parse_string(doc.c_str(), doc.size(), ' ',
+                   [&words](qs::string_view &w) { words.push_back(w); });
+  std::vector<std::string> strings;
+  for (auto &w : words) {
+    strings.emplace_back(w.data(), w.size());
+  }
+
+  BENCHMARK("qs::hash_bytes") {
+    u64 sum = 0;
+    for (auto &w : words) {
+      sum += qs::hash_bytes(w.data(), w.size());
+    }
+    return sum;
+  };
+
+  BENCHMARK("qs::djb2") {
+    u64 sum = 0;
+    for (auto &s : strings) {
+      sum += qs::djb2((const uint8_t *)s.c_str());
+    }
+    return sum;
+  };
+}
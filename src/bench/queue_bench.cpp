@@ -0,0 +1,69 @@
+#include "../test/catch_amalgamated.hpp"
+
+#include <qs/queue.hpp>
+
+#include <atomic>
+#include <thread>
+
+#define BENCH_PAIRS 4
+#define BENCH_ITEMS 20000
+
+// BENCH_PAIRS producers and BENCH_PAIRS consumers pass BENCH_ITEMS items each
+// through one queue
+static long concurrent_queue_round() {
+  qs::concurrent_queue<int> q;
+  std::atomic<long> sum{0};
+  std::thread threads[BENCH_PAIRS * 2];
+  for (int p = 0; p < BENCH_PAIRS; p++) {
+    threads[p] = std::thread([&q]() {
+      for (int i = 0; i < BENCH_ITEMS; i++) {
+        q.enqueue(i);
+      }
+    });
+  }
+  for (int c = 0; c < BENCH_PAIRS; c++) {
+    threads[BENCH_PAIRS + c] = std::thread([&q, &sum]() {
+      long local = 0;
+      for (int i = 0; i < BENCH_ITEMS; i++) {
+        local += q.dequeue(nullptr).get();
+      }
+      sum += local;
+    });
+  }
+  for (auto &t : threads) {
+    t.join();
+  }
+  return sum.load();
+}
+
+static long mpmc_queue_round(std::size_t capacity) {
+  qs::mpmc_queue<int> q{capacity};
+  std::atomic<long> sum{0};
+  std::thread threads[BENCH_PAIRS * 2];
+  for (int p = 0; p < BENCH_PAIRS; p++) {
+    threads[p] = std::thread([&q]() {
+      for (int i = 0; i < BENCH_ITEMS; i++) {
+        q.enqueue(i);
+      }
+    });
+  }
+  for (int c = 0; c < BENCH_PAIRS; c++) {
+    threads[BENCH_PAIRS + c] = std::thread([&q, &sum]() {
+      long local = 0;
+      for (int i = 0; i < BENCH_ITEMS; i++) {
+        local += q.dequeue().get();
+      }
+      sum += local;
+    });
+  }
+  for (auto &t : threads) {
+    t.join();
+  }
+  return sum.load();
+}
+
+TEST_CASE("queues under producer and consumer contention", "[queue]") {
+  BENCHMARK("concurrent queue") { return concurrent_queue_round(); };
+  BENCHMARK("mpmc queue with 64 slots") { return mpmc_queue_round(64); };
+  BENCHMARK("mpmc queue with 4096 slots") { return mpmc_queue_round(4096); };
+}
@@ -0,0 +1,140 @@
+#include "../test/catch_amalgamated.hpp"
+
+#include <qs/distances.hpp>
+#include <qs/job.h>
+#include <qs/scheduler.hpp>
+#include <qs/string_view.h>
+#include <qs/work_stealing_scheduler.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <sys/resource.h>
+#include <thread>
+
+#define BENCH_THREADS 4
+#define IDLE_THREADS 16
+
+// Mimics match_doc_job: most documents are small but every so often a huge
+// one arrives and takes many times longer than the rest
+struct document_job : public qs::job {
+  int words;
+  std::atomic<int> *sink;
+
+  document_job(int words, std::atomic<int> *sink) : words(words), sink(sink) {}
+
+  void operator()() override {
+    auto w1 = qs::string_view("congregation");
+    auto w2 = qs::string_view("civitavecchia");
+    int sum = 0;
+    for (int i = 0; i < words; i++) {
+      sum += qs::bit_parallel_edit_distance(w1, w2);
+    }
+    sink->fetch_add(sum, std::memory_order_relaxed);
+  }
+};
+
+template <typename S> static int run_documents(S &sched) {
+  std::atomic<int> sink{0};
+  for (int i = 0; i < 2000; i++) {
+    int words = i % 100 == 0 ? 50000 : 500;
+    sched.submit_job(new document_job(words, &sink));
+  }
+  sched.wait_all_finish();
+  return sink.load();
+}
+
+TEST_CASE("schedulers on a skewed document workload", "[scheduler]") {
+  BENCHMARK_ADVANCED("round robin")(Catch::Benchmark::Chronometer meter) {
+    qs::scheduler sched{BENCH_THREADS};
+    meter.measure([&sched] { return run_documents(sched); });
+  };
+
+  BENCHMARK_ADVANCED("work stealing")(Catch::Benchmark::Chronometer meter) {
+    qs::work_stealing_scheduler sched{BENCH_THREADS};
+    meter.measure([&sched] { return run_documents(sched); });
+  };
+}
+
+using bench_clock = std::chrono::steady_clock;
+
+struct timestamp_job : public qs::job {
+  std::atomic<i64> *started;
+
+  explicit timestamp_job(std::atomic<i64> *started) : started(started) {}
+
+  void operator()() override {
+    started->store(bench_clock::now().time_since_epoch().count());
+  }
+};
+
+static double cpu_ms() {
+  rusage usage{};
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_utime.tv_sec * 1e3 + usage.ru_utime.tv_usec / 1e3 +
+         usage.ru_stime.tv_sec * 1e3 + usage.ru_stime.tv_usec / 1e3;
+}
+
+// Cpu time used by an idle pool of IDLE_THREADS workers over 200ms of wall
+// time, after every worker has had the chance to run a job
+template <typename S> static double idle_cpu_ms() {
+  S sched{IDLE_THREADS};
+  std::atomic<i64> started{0};
+  for (int i = 0; i < IDLE_THREADS; i++) {
+    sched.submit_job(new timestamp_job(&started));
+  }
+  sched.wait_all_finish();
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  double before = cpu_ms();
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  return cpu_ms() - before;
+}
+
+// Median time from submit_job until the job starts running on a pool whose
+// workers have had time to park
+template <typename S> static double parked_wake_up_us() {
+  S sched{BENCH_THREADS};
+  std::atomic<i64> started{0};
+  qs::vector<double> latencies{128};
+  for (int i = 0; i < 100; i++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    auto submitted = bench_clock::now().time_since_epoch().count();
+    sched.submit_job(new timestamp_job(&started));
+    sched.wait_all_finish();
+    latencies.push(
+        std::chrono::duration<double, std::micro>(
+            bench_clock::duration{started.load() - submitted})
+            .count());
+  }
+  std::sort(latencies.get_data(), latencies.get_data() + latencies.get_size());
+  return latencies[latencies.get_size() / 2];
+}
+
+TEST_CASE("idle cpu and wake up latency", "[scheduler]") {
+  WARN("idle cpu over 200ms: round robin "
+       << idle_cpu_ms<qs::scheduler>() << "ms, work stealing "
+       << idle_cpu_ms<qs::work_stealing_scheduler>() << "ms");
+  WARN("median wake up of a parked pool: round robin "
+       << parked_wake_up_us<qs::scheduler>() << "us, work stealing "
+       << parked_wake_up_us<qs::work_stealing_scheduler>() << "us");
+
+  BENCHMARK_ADVANCED("round robin round trip of an empty job")
+  (Catch::Benchmark::Chronometer meter) {
+    qs::scheduler sched{BENCH_THREADS};
+    std::atomic<i64> started{0};
+    meter.measure([&] {
+      sched.submit_job(new timestamp_job(&started));
+      sched.wait_all_finish();
+    });
+  };
+
+  BENCHMARK_ADVANCED("work stealing round trip of an empty job")
+  (Catch::Benchmark::Chronometer meter) {
+    qs::work_stealing_scheduler sched{BENCH_THREADS};
+    std::atomic<i64> started{0};
+    meter.measure([&] {
+      sched.submit_job(new timestamp_job(&started));
+      sched.wait_all_finish();
+    });
+  };
+}
@@ -1,25 +1,140 @@
 #include <core.h>
+#include <qs/arena.hpp>
 #include <qs/bk_tree.hpp>
+#include <qs/deletion_index.hpp>
 #include <qs/entry.hpp>
+#include <qs/flat_bk_tree.hpp>
+#include <qs/flat_scan.hpp>
+#include <qs/flat_trie.hpp>
 #include <qs/hash_set.hpp>
 #include <qs/hash_table.hpp>
 #include <qs/job.h>
 #include <qs/memory.hpp>
+#include <qs/metrics.hpp>
 #include <qs/parser.hpp>
+#include <qs/partition_index.hpp>
+#include <qs/queue.hpp>
 #include <qs/scheduler.hpp>
 #include <qs/string_view.h>
 #include <qs/thread_safe_container.hpp>
 #include <qs/vector.hpp>
+#include <qs/word_dictionary.hpp>
+#include <qs/work_stealing_scheduler.hpp>
+
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <unistd.h>
 
 #define DEFAULT_THREADS_COUNT 16
+#define DEFAULT_INDEX_THREADS_COUNT 4
+#define MATCH_WORDS_PER_JOB 16
+// Documents that have been matched but not picked up by GetNextAvailRes. A
+// match_doc job blocks once this many are waiting
+#define FINISHED_RESULTS_CAPACITY 16384
+// QueryIDs per block of an AnswerArena
+#define ANSWER_BLOCK_SIZE 16384
+// Used to size the word set of a document up front
+#define DOCUMENT_BYTES_PER_WORD 8
+#define DOCUMENT_ARENA_POOL_SIZE 64
+#define DOCUMENT_ARENA_MAX_CAPACITY (16 << 20)
+// The match cache is split in shards with a lock each. A full shard is
+// emptied before the next insertion
+#define MATCH_CACHE_SHARDS 64
+#define MATCH_CACHE_SHARD_CAPACITY 2048
+// A stale cache entry is recomputed from the tree instead of being brought up
+// to date when more than 1/MATCH_CACHE_DELTA_RATIO of the tree is new
+#define MATCH_CACHE_DELTA_RATIO 4
+// A tree is rebuilt without its removed words once they are this percent of
+// its nodes, and at least INDEX_COMPACTION_MIN_DEAD of them
+#define INDEX_COMPACTION_DEAD_PERCENT 25
+#define INDEX_COMPACTION_MIN_DEAD 64
+// The edit snapshots built with the deletion engine use a BK-tree instead
+// when the deletion variants of their words would take more than this
+#define DELETION_INDEX_MAX_BYTES (256 << 20)
+// Snapshots of at most this many words are scanned whatever their engine.
+// SEARCH_SCAN_MAX_WORDS overrides it, 0 turns scanning off
+#define INDEX_SCAN_MAX_WORDS 4096
+
+// Build with -Dscheduler=round_robin to compare against the old scheduler
+#ifdef QS_ROUND_ROBIN_SCHEDULER
+using core_scheduler = qs::scheduler;
+#else
+using core_scheduler = qs::work_stealing_scheduler;
+#endif
+
+// What the core records while metrics are enabled, see EnableMetrics. The
+// histograms are in nanoseconds unless their name says otherwise
+struct CoreMetrics {
+  qs::metrics::counter documents =
+      qs::metrics::register_counter("documents");
+  qs::metrics::counter answers = qs::metrics::register_counter("answers");
+  qs::metrics::counter cache_hits =
+      qs::metrics::register_counter("match_cache.hits");
+  qs::metrics::counter cache_deltas =
+      qs::metrics::register_counter("match_cache.deltas");
+  qs::metrics::counter cache_misses =
+      qs::metrics::register_counter("match_cache.misses");
+  qs::metrics::counter distance_calls =
+      qs::metrics::register_counter("distance.calls");
+  // Candidates checked against their word filter before their distance, and
+  // the ones it ruled out
+  qs::metrics::counter filter_checks =
+      qs::metrics::register_counter("distance.filter_checks");
+  qs::metrics::counter filter_rejects =
+      qs::metrics::register_counter("distance.filter_rejects");
+  // Waiting for the index jobs and publishing a snapshot
+  qs::metrics::histogram publish =
+      qs::metrics::register_histogram("match_document.publish_ns");
+  // Splitting the document and packing its distinct words
+  qs::metrics::histogram parse =
+      qs::metrics::register_histogram("match_document.parse_ns");
+  // Jobs of the search pool that are queued or running, sampled by every
+  // MatchDocument
+  qs::metrics::histogram pending_jobs =
+      qs::metrics::register_histogram("scheduler.pending_jobs");
+  // From MatchDocument to the start of the match_doc job
+  qs::metrics::histogram queued =
+      qs::metrics::register_histogram("match_doc.queued_ns");
+  qs::metrics::histogram words =
+      qs::metrics::register_histogram("match_doc.words_ns");
+  // Collecting and sorting the matched queries
+  qs::metrics::histogram answer =
+      qs::metrics::register_histogram("match_doc.answer_ns");
+  // From MatchDocument until the answer is ready
+  qs::metrics::histogram total =
+      qs::metrics::register_histogram("match_doc.total_ns");
+  qs::metrics::histogram traverse =
+      qs::metrics::register_histogram("tree.traverse_ns");
+  // The bytes of every deletion index that is built
+  qs::metrics::histogram deletion_bytes =
+      qs::metrics::register_histogram("deletion_index.bytes");
+  // Deletion indices over DELETION_INDEX_MAX_BYTES that fell back to a tree
+  qs::metrics::counter deletion_fallbacks =
+      qs::metrics::register_counter("deletion_index.fallbacks");
+  // Snapshots small enough to be scanned instead, see scan_max_words
+  qs::metrics::counter scan_snapshots =
+      qs::metrics::register_counter("flat_scan.snapshots");
+  // Time GetNextAvailRes and GetNextAvailResBatch block for an answer
+  qs::metrics::histogram wait =
+      qs::metrics::register_histogram("get_next_avail_res.wait_ns");
+};
+
+static const CoreMetrics core_metrics{};
 
 struct Query {
   QueryID id;
   bool active;
   MatchType match_type;
   unsigned int match_dist;
-  qs::string query_str;
-  qs::hash_set<qs::string_view> unique_words{MAX_QUERY_WORDS};
+  // The distinct words of the query as IDs of the word dictionary
+  u32 word_ids[MAX_QUERY_WORDS];
+  u32 words_count = 0;
+  // Dense number of the query among the active ones, see query_slots
+  u32 slot = 0;
+  // The sequence of the last snapshot published before the query started
+  u32 sequence = 0;
 
   Query(QueryID id, bool active, MatchType match_type, unsigned int match_dist)
       : id(id), active(active), match_type(match_type), match_dist(match_dist) {
@@ -27,45 +142,206 @@ struct Query {
 };
 
 static qs::hash_table<QueryID, qs::unique_pointer<Query>> queries{4096};
-struct QueryResult {
+// Ended queries are freed once the jobs that remove their postings from the
+// mutable indices are done
+static qs::vector<qs::unique_pointer<Query>> ended_queries{64};
+
+static_assert(MAX_QUERY_WORDS <= 8, "the words of a query must fit in a u8");
+
+// An entry of the posting list of an indexed word: a query that has the word
+// and the bit of the word in that query. Everything a document needs to
+// record the match is inline so it does not have to read the query
+struct Posting {
+  // Only identifies the posting in the mutable indices. Ended queries are
+  // freed while old snapshots still hold their postings
   Query *query;
-  bool matched = false;
-  qs::hash_set<qs::string_view> matched_words;
+  QueryID id;
+  u32 slot;
+  u8 word_bit;
+  // The bits of all the words of the query
+  u8 all_words;
+  u16 match_dist;
 };
 
+// Every active query has a slot so the state of a document is a flat array
+// indexed by slot. The slot of an ended query is reused by the next query; a
+// document only sees the queries of its snapshot so two queries with the same
+// slot never meet in one document
+static qs::vector<u32> free_slots{64};
+static u32 query_slots = 0;
+
+// Everything a document needs while it is matched, including the
+// DocumentResults itself and its distinct words, is allocated from its
+// arena. The arena is reset and goes back to the pool in one shot once the
+// answer has been handed out.
+//
+// The arena is not thread safe. Everything is allocated before the document
+// is submitted and the match jobs only update the arrays with atomics.
 struct DocumentResults {
+  qs::arena *arena;
   DocID docId{};
-  qs::thread_safe_container<qs::hash_table<QueryID, QueryResult>> results;
-  qs::hash_set<qs::string_view> words;
-  qs::string doc_str;
-  std::size_t answer_len = 0;
-  QueryID *answer = nullptr;
+  u32 slots;
+  // The matched words of the query of every slot, one bit per word
+  std::atomic<u8> *matched_words;
+  // The queries that matched all their words, in the order they completed
+  QueryID *matched_queries;
+  std::atomic<u32> matched_count{0};
+  // The distinct words of the document. The text itself is never kept
+  qs::packed_word *words = nullptr;
+  u32 words_count = 0;
+  // A document handed over by MatchDocumentOwned. The job parses it and frees
+  // it as soon as its words are packed
+  char *owned_doc = nullptr;
 
-  DocumentResults() = default;
-  DocumentResults(DocID docId, size_t results_cap, const char *doc_str)
-      : docId{docId}, results{qs::hash_table<QueryID, QueryResult>{
-                          results_cap}},
-        doc_str(doc_str) {}
-  DocumentResults(DocumentResults &&other) noexcept
-      : docId{other.docId}, results{std::move(other.results)},
-        words{std::move(other.words)}, doc_str(std::move(other.doc_str)),
-        answer_len{other.answer_len}, answer{other.answer} {}
+  DocumentResults(qs::arena *arena, DocID docId, u32 slots)
+      : arena{arena}, docId{docId}, slots{slots},
+        matched_words{arena->allocate<std::atomic<u8>>(slots)},
+        matched_queries{arena->allocate<QueryID>(slots)} {
+    for (u32 i = 0; i < slots; i++) {
+      new (&matched_words[i]) std::atomic<u8>{0};
+    }
+  }
   DocumentResults(const DocumentResults &other) = delete;
 };
 
+// Arenas of documents that have been handed out, ready to be reused
+static qs::mpmc_queue<qs::arena *> document_arenas{DOCUMENT_ARENA_POOL_SIZE};
+
+static qs::arena *take_document_arena() {
+  qs::arena *arena;
+  if (document_arenas.try_dequeue(arena)) {
+    return arena;
+  }
+  return new qs::arena{};
+}
+
+// Tokenizes and deduplicates a document into packed words in its arena, at
+// most 32 bytes per distinct word, so the text does not have to outlive the
+// call. The word set only lives while the document is parsed and comes from
+// a scratch arena of the calling thread
+static void ingest_document(DocumentResults *r, const char *doc,
+                            std::size_t doc_len) {
+  static thread_local qs::arena scratch;
+  {
+    qs::hash_set<qs::string_view> words{doc_len / DOCUMENT_BYTES_PER_WORD + 2,
+                                        &scratch};
+    qs::parse_string(doc, doc_len, ' ',
+                     [&words](qs::string_view &word) { words.insert(word); });
+    r->words_count = (u32)words.get_size();
+    r->words = r->arena->allocate<qs::packed_word>(r->words_count);
+    u32 i = 0;
+    for (auto &w : words) {
+      new (&r->words[i++]) qs::packed_word{w};
+    }
+  }
+  scratch.reset();
+}
+
+static void give_back_document_arena(qs::arena *arena) {
+  arena->reset();
+  // Do not hold on to the memory of a huge document forever
+  if (arena->get_capacity() > DOCUMENT_ARENA_MAX_CAPACITY ||
+      !document_arenas.try_enqueue(arena)) {
+    delete arena;
+  }
+}
+
+// The sorted answers of finished documents are bump allocated from blocks
+// owned by the worker that matched the document, so there is no malloc per
+// document on either side. A block can be reused by its owner once the
+// consumer has released every answer in it.
+struct AnswerBlock {
+  // Answers in the block that have not been released by the consumer
+  std::atomic<std::size_t> live{0};
+  std::size_t capacity;
+  std::size_t used = 0;
+  QueryID *ids;
+
+  explicit AnswerBlock(std::size_t capacity)
+      : capacity{capacity}, ids{new QueryID[capacity]} {}
+  AnswerBlock(const AnswerBlock &other) = delete;
+  ~AnswerBlock() { delete[] ids; }
+
+  void release() { live.fetch_sub(1, std::memory_order_release); }
+};
+
+// Only used by the thread that owns it
+class AnswerArena {
+  AnswerBlock *current = nullptr;
+  qs::vector<AnswerBlock *> blocks{8};
+
+  AnswerBlock *next_block(std::size_t n) {
+    for (auto block : blocks) {
+      if (block != current && block->capacity >= n &&
+          block->live.load(std::memory_order_acquire) == 0) {
+        block->used = 0;
+        return block;
+      }
+    }
+    auto block = new AnswerBlock{n > ANSWER_BLOCK_SIZE ? n : ANSWER_BLOCK_SIZE};
+    blocks.push(block);
+    return block;
+  }
+
+public:
+  AnswerArena() = default;
+  AnswerArena(const AnswerArena &other) = delete;
+
+  // Blocks with answers that were never picked up are leaked since the
+  // consumer may still read them
+  ~AnswerArena() {
+    for (auto block : blocks) {
+      if (block->live.load(std::memory_order_acquire) == 0) {
+        delete block;
+      }
+    }
+  }
+
+  QueryID *allocate(std::size_t n, AnswerBlock **owner) {
+    if (current == nullptr || current->capacity - current->used < n) {
+      current = next_block(n);
+    }
+    auto ids = current->ids + current->used;
+    current->used += n;
+    current->live.fetch_add(1, std::memory_order_relaxed);
+    *owner = current;
+    return ids;
+  }
+};
+
+// What GetNextAvailRes hands out. The rest of the DocumentResults is freed by
+// the job that matched the document
+struct FinishedDocument {
+  DocID docId{};
+  std::size_t answer_len = 0;
+  QueryID *answer = nullptr;
+  AnswerBlock *block = nullptr;
+};
+
 struct DistanceThresholdCounters {
   int hamming;
   int edit;
 };
-using qvec = qs::vector<Query *>;
-using entry = qs::entry<qvec>;
+using postings = qs::vector<Posting>;
+using entry = qs::word_entry<postings>;
+// Documents words are matched against hamming entries as packed words for the
+// SIMD hamming kernel
+using hamming_entry = qs::word_entry<postings, qs::packed_word>;
+
+// Every query word is interned once and all the indices below refer to it by
+// ID. Only the main thread interns words; jobs only read the slots of IDs they
+// got from a snapshot
+static qs::word_dictionary &dictionary() {
+  static qs::word_dictionary words{};
+  return words;
+}
 
 // thread safe hash_table
 using ts_hash_table =
-    qs::thread_safe_container<qs::hash_table<qs::string_view, qvec>>;
+    qs::thread_safe_container<qs::hash_table<u32, postings>>;
 
 static ts_hash_table &exact() {
-  static ts_hash_table container{qs::hash_table<qs::string_view, qvec>{4096}};
+  static ts_hash_table container{qs::hash_table<u32, postings>{4096}};
   return container;
 }
 
@@ -73,18 +349,23 @@ static ts_hash_table &exact() {
 using ts_bk_tree = qs::thread_safe_container<qs::bk_tree<entry>>;
 
 static ts_bk_tree &edit_bk_tree() {
-  static ts_bk_tree container{qs::bk_tree<entry>{&qs::edit_distance}};
+  static ts_bk_tree container{
+      qs::bk_tree<entry>{&qs::bit_parallel_edit_distance}};
   return container;
 }
 
-constexpr int HAMMING_BK_TREES = MAX_WORD_LENGTH - MIN_WORD_LENGTH;
-static ts_bk_tree *hamming_bk_trees() {
+// thread safe bk_tree over packed words for the SIMD hamming kernel
+using ts_hamming_bk_tree =
+    qs::thread_safe_container<qs::bk_tree<hamming_entry>>;
+
+constexpr int HAMMING_BK_TREES = MAX_WORD_LENGTH - MIN_WORD_LENGTH + 1;
+static ts_hamming_bk_tree *hamming_bk_trees() {
   static bool is_initialized = false;
-  static ts_bk_tree containers[HAMMING_BK_TREES];
+  static ts_hamming_bk_tree containers[HAMMING_BK_TREES];
   if (!is_initialized) {
     for (auto &i : containers) {
-      i = qs::thread_safe_container<qs::bk_tree<entry>>{
-          qs::bk_tree<entry>{&qs::hamming_distance}};
+      i = ts_hamming_bk_tree{
+          qs::bk_tree<hamming_entry>{&qs::packed_hamming_distance}};
     }
     is_initialized = true;
   }
@@ -94,99 +375,605 @@ static ts_bk_tree *hamming_bk_trees() {
 static qs::hash_table<unsigned int, DistanceThresholdCounters>
     thresholdCounters{32};
 
-ErrorCode InitializeIndex() { return EC_SUCCESS; }
+// The words of an index in the order they were added to it. The log only
+// grows, a word that is removed and added again is appended again, so the
+// size of the log when a snapshot is published is the vocabulary generation
+// of that snapshot and the words added between two generations are a range
+// of the log. Removed words are filtered out when the match cache resolves
+// them against a snapshot.
+//
+// Only the main thread adds words. The IDs are kept in chunks that never move
+// and readers only look at positions below the generation of their snapshot,
+// which are not written again, so they do not lock.
+class WordLog {
+  // The active queries of the index that use each word
+  qs::hash_table<u32, u32> uses{4096};
+  u32 *chunks[QS_DICTIONARY_MAX_CHUNKS] = {};
+  u32 size = 0;
+
+  void append(u32 id) {
+    u32 chunk = size >> QS_DICTIONARY_CHUNK_BITS;
+    if (chunk >= QS_DICTIONARY_MAX_CHUNKS) {
+      throw std::runtime_error("the word log is full");
+    }
+    if (chunks[chunk] == nullptr) {
+      chunks[chunk] = new u32[QS_DICTIONARY_CHUNK_SIZE];
+    }
+    chunks[chunk][size & (QS_DICTIONARY_CHUNK_SIZE - 1)] = id;
+    size++;
+  }
+
+public:
+  WordLog() = default;
+  WordLog(const WordLog &other) = delete;
+  ~WordLog() {
+    for (auto chunk : chunks) {
+      delete[] chunk;
+    }
+  }
+
+  // A new query of the index uses the word. It is appended if no active
+  // query used it
+  void add(u32 id) {
+    auto iter = uses.lookup(id);
+    if (iter == uses.end()) {
+      uses.insert(id, 1u);
+      append(id);
+    } else if ((*iter)++ == 0) {
+      append(id);
+    }
+  }
+
+  // A query that used the word ended
+  void remove(u32 id) {
+    auto iter = uses.lookup(id);
+    if (iter != uses.end() && *iter > 0) {
+      (*iter)--;
+    }
+  }
+
+  u32 operator[](u32 i) const {
+    return chunks[i >> QS_DICTIONARY_CHUNK_BITS]
+                 [i & (QS_DICTIONARY_CHUNK_SIZE - 1)];
+  }
+
+  u32 get_size() const { return size; }
+};
+
+static WordLog edit_log{};
+// One log for the hamming trees of every length
+static WordLog hamming_log{};
+
+// The snapshot of the exact index is keyed by the words themselves so
+// documents do not have to go through the dictionary
+using exact_table = qs::hash_table<qs::string_view, entry>;
+
+struct ThresholdSnapshot {
+  unsigned int match_dist;
+  DistanceThresholdCounters counters;
+};
+
+// What the snapshots of an index search with. The mutable index is always a
+// bk_tree, the engine only changes how its snapshots are laid out
+enum class IndexEngine { bk_tree, trie, deletion, partition, scan };
+
+// Edit distance searches can use a trie or a symmetric delete index instead.
+// Build with -Dedit_index=trie or deletion, or set SEARCH_EDIT_INDEX, to
+// compare them
+#if defined(QS_EDIT_INDEX_TRIE)
+static IndexEngine edit_engine = IndexEngine::trie;
+#elif defined(QS_EDIT_INDEX_DELETION)
+static IndexEngine edit_engine = IndexEngine::deletion;
+#else
+static IndexEngine edit_engine = IndexEngine::bk_tree;
+#endif
+
+// Hamming distance searches can split the words of every length in segments
+// and look them up instead, see partition_index. Build with
+// -Dhamming_index=partition or set SEARCH_HAMMING_INDEX
+#ifdef QS_HAMMING_INDEX_PARTITION
+static IndexEngine hamming_engine = IndexEngine::partition;
+#else
+static IndexEngine hamming_engine = IndexEngine::bk_tree;
+#endif
+
+// Most hamming buckets and small query sets have few words, and scoring all
+// of them in one pass beats any of the engines above
+static u32 scan_max_words = INDEX_SCAN_MAX_WORDS;
+
+// The frozen words of an index and its entries by word ID, to resolve the IDs
+// of the match cache against the snapshot the index belongs to. Only the
+// structure of the engine is built
+template <typename E> struct FlatIndex {
+  IndexEngine engine;
+  qs::flat_bk_tree<E> tree{};
+  qs::flat_trie<E> trie{};
+  qs::deletion_index<E> deletion{};
+  qs::partition_index<E> partition{};
+  qs::flat_scan<E> scan{};
+  qs::hash_table<u32, const E *> by_id;
+
+  FlatIndex(IndexEngine engine, std::size_t size)
+      : engine{engine}, by_id{size * 2 + 2} {}
+
+  std::size_t get_size() const {
+    switch (engine) {
+    case IndexEngine::trie:
+      return trie.get_size();
+    case IndexEngine::deletion:
+      return deletion.get_size();
+    case IndexEngine::partition:
+      return partition.get_size();
+    case IndexEngine::scan:
+      return scan.get_size();
+    default:
+      return tree.get_size();
+    }
+  }
+
+  qs::distance_function get_distance_function() const {
+    switch (engine) {
+    case IndexEngine::trie:
+      return trie.get_distance_function();
+    case IndexEngine::deletion:
+      return deletion.get_distance_function();
+    case IndexEngine::partition:
+      return partition.get_distance_function();
+    case IndexEngine::scan:
+      return scan.get_distance_function();
+    default:
+      return tree.get_distance_function();
+    }
+  }
+
+  const E *begin() const {
+    switch (engine) {
+    case IndexEngine::trie:
+      return trie.begin();
+    case IndexEngine::deletion:
+      return deletion.begin();
+    case IndexEngine::partition:
+      return partition.begin();
+    case IndexEngine::scan:
+      return scan.begin();
+    default:
+      return tree.begin();
+    }
+  }
+
+  const E *end() const {
+    switch (engine) {
+    case IndexEngine::trie:
+      return trie.end();
+    case IndexEngine::deletion:
+      return deletion.end();
+    case IndexEngine::partition:
+      return partition.end();
+    case IndexEngine::scan:
+      return scan.end();
+    default:
+      return tree.end();
+    }
+  }
+
+  // Calls on_match with every entry within threshold of word and its
+  // distance. Returns the number of distances, or trie rows, computed. The
+  // engines that keep word filters add their checks to stats
+  template <typename Fn>
+  std::size_t traverse(int threshold, const qs::packed_word &word,
+                       Fn on_match, qs::filter_stats *stats) const {
+    switch (engine) {
+    case IndexEngine::trie:
+      return trie.traverse(threshold, word, on_match);
+    case IndexEngine::deletion:
+      return deletion.traverse(threshold, word, on_match, stats);
+    case IndexEngine::partition:
+      return partition.traverse(threshold, word, on_match);
+    case IndexEngine::scan:
+      return scan.traverse(threshold, word, on_match, stats);
+    default:
+      return tree.traverse(threshold, word, on_match, stats);
+    }
+  }
+};
+
+// An immutable version of the indices. StartQuery and EndQuery only modify
+// the mutable indices above and a new snapshot is published before the next
+// MatchDocument. Every match_doc job keeps a reference to the snapshot that
+// was current when its document arrived so query churn does not have to wait
+// for in-flight documents. Parts that did not change are shared with the
+// previous snapshot.
+struct IndexSnapshot {
+  qs::shared_pointer<FlatIndex<entry>> edit;
+  qs::shared_pointer<FlatIndex<hamming_entry>> hamming[HAMMING_BK_TREES];
+  qs::shared_pointer<exact_table> exact;
+  qs::vector<ThresholdSnapshot> thresholds;
+  u32 edit_generation = 0;
+  u32 hamming_generation = 0;
+  // Counts the published snapshots. Unlike the generations it also moves
+  // when words are only removed
+  u32 sequence = 0;
+  // Every query of the snapshot has a slot below this
+  u32 query_slots = 0;
+};
+
+static qs::shared_pointer<IndexSnapshot> current_snapshot{};
+static u32 snapshot_sequence = 0;
+
+static bool index_changed = true;
+static bool edit_changed = true;
+static bool exact_changed = true;
+static bool hamming_changed[HAMMING_BK_TREES] = {false};
+
+// Snapshots only see the queries that were active when they were published
+static postings active_payload(const postings &payload) {
+  postings ret{payload.get_size() + 2};
+  for (auto p = payload.cbegin(); p != payload.cend(); ++p) {
+    if (p->query->active) {
+      ret.push(*p);
+    }
+  }
+  return ret;
+}
+
+template <typename E> static E copy_active(const E &e) {
+  return E(e.id, e.word, active_payload(e.payload));
+}
+
+template <typename E>
+static qs::shared_pointer<FlatIndex<E>>
+snapshot_tree(qs::thread_safe_container<qs::bk_tree<E>> *tree,
+              IndexEngine engine, int max_dist) {
+  auto src = tree->get_data();
+  if (scan_max_words > 0 && src->get_size() <= scan_max_words) {
+    engine = IndexEngine::scan;
+    qs::metrics::add(core_metrics.scan_snapshots);
+  }
+  auto flat = new FlatIndex<E>{engine, src->get_size()};
+  if (engine == IndexEngine::deletion) {
+    if (flat->deletion.rebuild(*src, max_dist, DELETION_INDEX_MAX_BYTES,
+                               &copy_active<E>)) {
+      qs::metrics::record(core_metrics.deletion_bytes,
+                          flat->deletion.get_memory());
+    } else {
+      qs::metrics::add(core_metrics.deletion_fallbacks);
+      flat->engine = IndexEngine::bk_tree;
+    }
+  }
+  if (flat->engine == IndexEngine::trie) {
+    flat->trie.rebuild(*src, &copy_active<E>);
+  } else if (flat->engine == IndexEngine::partition) {
+    flat->partition.rebuild(*src, max_dist, &copy_active<E>);
+  } else if (flat->engine == IndexEngine::scan) {
+    flat->scan.rebuild(*src, &copy_active<E>);
+  } else if (flat->engine == IndexEngine::bk_tree) {
+    flat->tree.rebuild(*src, &copy_active<E>);
+  }
+  // Removed words and words whose queries all ended have no postings
+  for (auto &e : *flat) {
+    if (e.payload.get_size() > 0) {
+      flat->by_id.insert(e.id, &e);
+    }
+  }
+  return qs::shared_pointer<FlatIndex<E>>(flat);
+}
+
+static qs::shared_pointer<exact_table> snapshot_exact() {
+  auto src = exact().get_data();
+  auto table = new exact_table{src->get_size() * 2 + 1};
+  for (auto iter = src->begin(); iter != src->end(); ++iter) {
+    auto payload = active_payload(*iter);
+    if (payload.get_size() == 0) {
+      continue;
+    }
+    auto word = &dictionary().get(iter.key());
+    table->insert(word->get_string_view(),
+                  entry{iter.key(), word, std::move(payload)});
+  }
+  return qs::shared_pointer<exact_table>(table);
+}
+
+// The biggest threshold of the active queries of match_type, up to cap. It is
+// what the deletion engine generates variants for and what the partition
+// engine splits words for. Searches with bigger thresholds verify every word
+static int max_threshold(MatchType match_type, int cap) {
+  int max_dist = 0;
+  for (auto iter = thresholdCounters.begin(); iter != thresholdCounters.end();
+       ++iter) {
+    int count = match_type == MT_EDIT_DIST ? (*iter).edit : (*iter).hamming;
+    if (count > 0 && (int)iter.key() > max_dist) {
+      max_dist = (int)iter.key();
+    }
+  }
+  return max_dist < cap ? max_dist : cap;
+}
+
+// The threshold the hamming snapshots were split for. The snapshots of every
+// length are rebuilt when it changes
+static int hamming_max_dist = -1;
+
+// Must only be called when no job is modifying the mutable indices
+static void publish_snapshot() {
+  auto next = new IndexSnapshot{};
+  bool first = current_snapshot.is_empty();
+
+  next->edit = edit_changed || first
+                   ? snapshot_tree(&edit_bk_tree(), edit_engine,
+                                   max_threshold(MT_EDIT_DIST,
+                                                 QS_DELETION_INDEX_MAX_DIST))
+                   : current_snapshot->edit;
+  next->exact = exact_changed || first ? snapshot_exact()
+                                       : current_snapshot->exact;
+  int hamming_dist = max_threshold(MT_HAMMING_DIST,
+                                   QS_PARTITION_INDEX_MAX_DIST);
+  bool resplit = hamming_engine == IndexEngine::partition &&
+                 hamming_dist != hamming_max_dist;
+  hamming_max_dist = hamming_dist;
+  for (int i = 0; i < HAMMING_BK_TREES; i++) {
+    next->hamming[i] =
+        hamming_changed[i] || resplit || first
+            ? snapshot_tree(&hamming_bk_trees()[i], hamming_engine,
+                            hamming_dist)
+            : current_snapshot->hamming[i];
+    hamming_changed[i] = false;
+  }
+  for (auto iter = thresholdCounters.begin(); iter != thresholdCounters.end();
+       ++iter) {
+    next->thresholds.push(ThresholdSnapshot{iter.key(), *iter});
+  }
+  next->edit_generation = edit_log.get_size();
+  next->hamming_generation = hamming_log.get_size();
+  next->sequence = ++snapshot_sequence;
+  next->query_slots = query_slots;
+
+  edit_changed = false;
+  exact_changed = false;
+  index_changed = false;
+  current_snapshot = qs::shared_pointer<IndexSnapshot>(next);
+  ended_queries.clear();
+}
+
+// Reads a positive number from the environment or returns fallback
+static u32 env_number(const char *name, u32 fallback, bool allow_zero) {
+  const char *value = std::getenv(name);
+  if (value && std::strlen(value)) {
+    u32 number = std::atoi(value);
+    if (number || allow_zero) {
+      return number;
+    }
+  }
+  return fallback;
+}
+
+// SEARCH_METRICS=1 turns the metrics on and SEARCH_METRICS_SIGNAL makes a
+// signal dump them to stderr, for programs that do not use the metrics API.
+// SEARCH_EDIT_INDEX=trie, deletion or bk_tree picks the engine of the edit
+// distance snapshots and SEARCH_HAMMING_INDEX=partition or bk_tree the one
+// of the hamming snapshots, other values are ignored.
+// SEARCH_SCAN_MAX_WORDS is the size up to which snapshots are scanned
+ErrorCode InitializeIndex() {
+  const char *engine = std::getenv("SEARCH_EDIT_INDEX");
+  if (engine != nullptr) {
+    if (std::strcmp(engine, "trie") == 0) {
+      edit_engine = IndexEngine::trie;
+    } else if (std::strcmp(engine, "deletion") == 0) {
+      edit_engine = IndexEngine::deletion;
+    } else if (std::strcmp(engine, "bk_tree") == 0) {
+      edit_engine = IndexEngine::bk_tree;
+    }
+    edit_changed = true;
+  }
+  engine = std::getenv("SEARCH_HAMMING_INDEX");
+  if (engine != nullptr) {
+    if (std::strcmp(engine, "partition") == 0) {
+      hamming_engine = IndexEngine::partition;
+    } else if (std::strcmp(engine, "bk_tree") == 0) {
+      hamming_engine = IndexEngine::bk_tree;
+    }
+    for (auto &changed : hamming_changed) {
+      changed = true;
+    }
+  }
+  scan_max_words =
+      env_number("SEARCH_SCAN_MAX_WORDS", INDEX_SCAN_MAX_WORDS, true);
+  if (env_number("SEARCH_METRICS", 0, true) != 0) {
+    EnableMetrics(1);
+  }
+  u32 signum = env_number("SEARCH_METRICS_SIGNAL", 0, true);
+  if (signum != 0) {
+    return DumpMetricsOnSignal((int)signum, STDERR_FILENO);
+  }
+  return EC_SUCCESS;
+}
 
-ErrorCode DestroyIndex() { return EC_SUCCESS; }
+ErrorCode DestroyIndex() {
+  qs::arena *arena;
+  while (document_arenas.try_dequeue(arena)) {
+    delete arena;
+  }
+  return EC_SUCCESS;
+}
 
-static void add_to_tree(Query *q, qs::string_view *str, ts_bk_tree *tree) {
+template <typename E>
+static void add_to_tree(Posting p, u32 id, const qs::packed_word *word,
+                        qs::thread_safe_container<qs::bk_tree<E>> *tree) {
   auto t = tree->lock();
   if (t == nullptr)
     return;
-  auto found = t->find(*str);
+  auto found = t->find(*word);
   if (found == nullptr) {
-    auto en = entry(*str);
-    en.payload.push(q);
+    auto en = E(id, word);
+    en.payload.push(p);
     t->insert(en);
   } else {
-    found->payload.push(q);
+    found->payload.push(p);
   }
   tree->unlock();
 }
 
-struct add_to_tree_job : public qs::job {
-  Query *q;
-  qs::string_view *str;
-  ts_bk_tree *tree;
+template <typename E> struct add_to_tree_job : public qs::job {
+  Posting p;
+  u32 id;
+  const qs::packed_word *word;
+  qs::thread_safe_container<qs::bk_tree<E>> *tree;
 
-  add_to_tree_job(Query *q, qs::string_view *str, ts_bk_tree *tree)
-      : q{q}, str{str}, tree{tree} {}
+  add_to_tree_job(Posting p, u32 id, const qs::packed_word *word,
+                  qs::thread_safe_container<qs::bk_tree<E>> *tree)
+      : p{p}, id{id}, word{word}, tree{tree} {}
 
-  void operator()() override { add_to_tree(q, str, tree); }
+  void operator()() override { add_to_tree(p, id, word, tree); }
 };
 
-static void add_to_hash_table(Query *q, qs::string_view *str,
-                              ts_hash_table *ht) {
+static void add_to_hash_table(Posting p, u32 id, ts_hash_table *ht) {
   auto e = ht->lock();
   if (e == nullptr)
     return;
-  auto f = e->lookup(*str);
+  auto f = e->lookup(id);
   if (f == e->end()) {
-    auto qv = qvec{};
-    qv.push(q);
-    e->insert(*str, qv);
+    auto pv = postings{};
+    pv.push(p);
+    e->insert(id, pv);
   } else {
-    f->push(q);
+    f->push(p);
   }
   ht->unlock();
 }
 
 struct add_to_hash_table_job : public qs::job {
-  Query *q;
-  qs::string_view *str;
+  Posting p;
+  u32 id;
   ts_hash_table *ht;
 
-  add_to_hash_table_job(Query *q, qs::string_view *str, ts_hash_table *ht)
-      : q{q}, str{str}, ht{ht} {}
+  add_to_hash_table_job(Posting p, u32 id, ts_hash_table *ht)
+      : p{p}, id{id}, ht{ht} {}
 
-  void operator()() override { add_to_hash_table(q, str, ht); }
+  void operator()() override { add_to_hash_table(p, id, ht); }
 };
 
-static qs::scheduler &job_scheduler() {
-  static bool scheduler_initialized = false;
-  static u32 threads = DEFAULT_THREADS_COUNT;
-  if (!scheduler_initialized) {
-    const char *search_threads = std::getenv("SEARCH_THREADS");
-    if (search_threads && std::strlen(search_threads)) {
-      threads = std::atoi(search_threads);
-      if (!threads) {
-        threads = DEFAULT_THREADS_COUNT;
+// Drops the posting of q. The order of a posting list does not matter so the
+// last posting takes its place
+static void remove_posting(postings *payload, Query *q) {
+  auto data = payload->get_data();
+  std::size_t size = payload->get_size();
+  for (std::size_t i = 0; i < size; i++) {
+    if (data[i].query == q) {
+      auto last = payload->pop();
+      if (i != size - 1) {
+        data[i] = last;
+      }
+      return;
+    }
+  }
+}
+
+// Removes the words that are left without queries. Matching only reads the
+// snapshots so compacting the mutable tree here never blocks documents
+template <typename E>
+static void remove_from_tree(Query *q, const qs::packed_word *word,
+                             qs::thread_safe_container<qs::bk_tree<E>> *tree) {
+  auto t = tree->lock();
+  if (t == nullptr)
+    return;
+  auto found = t->find(*word);
+  if (found != nullptr) {
+    remove_posting(&found->payload, q);
+    if (found->payload.get_size() == 0) {
+      t->remove(*word);
+      std::size_t dead = t->get_dead_count();
+      if (dead >= INDEX_COMPACTION_MIN_DEAD &&
+          dead * 100 >= t->get_size() * INDEX_COMPACTION_DEAD_PERCENT) {
+        t->compact();
       }
     }
   }
-  static qs::scheduler sched{threads};
+  tree->unlock();
+}
+
+template <typename E> struct remove_from_tree_job : public qs::job {
+  Query *q;
+  const qs::packed_word *word;
+  qs::thread_safe_container<qs::bk_tree<E>> *tree;
+
+  remove_from_tree_job(Query *q, const qs::packed_word *word,
+                       qs::thread_safe_container<qs::bk_tree<E>> *tree)
+      : q{q}, word{word}, tree{tree} {}
+
+  void operator()() override { remove_from_tree(q, word, tree); }
+};
+
+static void remove_from_hash_table(Query *q, u32 id, ts_hash_table *ht) {
+  auto e = ht->lock();
+  if (e == nullptr)
+    return;
+  auto f = e->lookup(id);
+  if (f != e->end()) {
+    remove_posting(&*f, q);
+    if (f->get_size() == 0) {
+      e->remove(id);
+    }
+  }
+  ht->unlock();
+}
+
+struct remove_from_hash_table_job : public qs::job {
+  Query *q;
+  u32 id;
+  ts_hash_table *ht;
+
+  remove_from_hash_table_job(Query *q, u32 id, ts_hash_table *ht)
+      : q{q}, id{id}, ht{ht} {}
+
+  void operator()() override { remove_from_hash_table(q, id, ht); }
+};
+
+// Runs the insertions to the mutable indices. It is separate from the
+// job_scheduler so publishing a snapshot only waits for pending insertions
+// and not for documents that are being matched
+static core_scheduler &index_scheduler() {
+  static core_scheduler sched{DEFAULT_INDEX_THREADS_COUNT};
   return sched;
 }
 
-bool query_has_started = false;
+// The search pool is also used from inside its own jobs so the settings are
+// only read once, while the function local static is initialized
+static core_scheduler &job_scheduler() {
+  // A spin budget of 0 parks the idle workers right away
+  static core_scheduler sched{
+      env_number("SEARCH_THREADS", DEFAULT_THREADS_COUNT, false),
+      env_number("SEARCH_SPIN_BUDGET", QS_DEFAULT_SPIN_BUDGET, true)};
+  return sched;
+}
 
-std::size_t active_queries = 0;
 ErrorCode StartQuery(QueryID query_id, const char *query_str,
                      MatchType match_type, unsigned int match_dist) {
-  active_queries++;
-  query_has_started = true;
+  index_changed = true;
   auto q = qs::make_unique<Query>(query_id, true, match_type, match_dist);
-  q->query_str = qs::string{query_str};
-  qs::parse_string(q->query_str.data(), ' ', [&q](qs::string_view &word) {
-    q->unique_words.insert(word);
+  qs::parse_string(query_str, ' ', [&q](qs::string_view &word) {
+    u32 id = dictionary().intern(word);
+    for (u32 i = 0; i < q->words_count; i++) {
+      if (q->word_ids[i] == id) {
+        return;
+      }
+    }
+    q->word_ids[q->words_count++] = id;
   });
+  q->slot = free_slots.get_size() > 0 ? free_slots.pop() : query_slots++;
+  q->sequence = snapshot_sequence;
+  // The posting of the i-th word is posting(i)
+  u8 all_words = (u8)((1u << q->words_count) - 1);
+  auto posting = [&q, all_words](u32 i) {
+    return Posting{q.get(), q->id, q->slot, (u8)(1u << i), all_words,
+                   (u16)q->match_dist};
+  };
 
   if (match_type == MT_EDIT_DIST) {
-    std::size_t i = 0;
-    for (auto &str : q->unique_words) {
-      job_scheduler().submit_job(
-          new add_to_tree_job{q.get(), &str, &edit_bk_tree()});
-      i++;
+    for (u32 i = 0; i < q->words_count; i++) {
+      u32 id = q->word_ids[i];
+      index_scheduler().submit_job(new add_to_tree_job<entry>{
+          posting(i), id, &dictionary().get(id), &edit_bk_tree()});
+      edit_log.add(id);
     }
+    edit_changed = true;
     auto iter = thresholdCounters.lookup(q->match_dist);
     if (iter == thresholdCounters.end()) {
       thresholdCounters.insert(q->match_dist, DistanceThresholdCounters{0, 1});
@@ -194,11 +981,14 @@ ErrorCode StartQuery(QueryID query_id, const char *query_str,
       iter->edit++;
     }
   } else if (match_type == MT_HAMMING_DIST) {
-    std::size_t i = 0;
-    for (auto &str : q->unique_words) {
-      job_scheduler().submit_job(new add_to_tree_job{
-          q.get(), &str, &hamming_bk_trees()[str.size() - MIN_WORD_LENGTH]});
-      i++;
+    for (u32 i = 0; i < q->words_count; i++) {
+      u32 id = q->word_ids[i];
+      auto word = &dictionary().get(id);
+      index_scheduler().submit_job(new add_to_tree_job<hamming_entry>{
+          posting(i), id, word,
+          &hamming_bk_trees()[word->size() - MIN_WORD_LENGTH]});
+      hamming_changed[word->size() - MIN_WORD_LENGTH] = true;
+      hamming_log.add(id);
     }
     auto iter = thresholdCounters.lookup(q->match_dist);
     if (iter == thresholdCounters.end()) {
@@ -208,13 +998,13 @@ ErrorCode StartQuery(QueryID query_id, const char *query_str,
     }
 
   } else if (match_type == MT_EXACT_MATCH) {
-    std::size_t i = 0;
-    for (auto &str : q->unique_words) {
-      job_scheduler().submit_job(
-          new add_to_hash_table_job{q.get(), &str, &exact()});
-      i++;
+    for (u32 i = 0; i < q->words_count; i++) {
+      index_scheduler().submit_job(
+          new add_to_hash_table_job{posting(i), q->word_ids[i], &exact()});
     }
+    exact_changed = true;
   } else {
+    free_slots.push(q->slot);
     return EC_FAIL;
   }
   queries.insert(std::move(query_id), std::move(q));
@@ -222,185 +1012,516 @@ ErrorCode StartQuery(QueryID query_id, const char *query_str,
 }
 
 ErrorCode EndQuery(QueryID query_id) {
-  active_queries--;
-  job_scheduler().wait_all_finish();
   auto i = queries.lookup(query_id);
   if (i == queries.end()) {
     return EC_FAIL;
   }
   auto q = i->get();
+  // The insertions of a query that started after the last snapshot may still
+  // be queued and must not run after its removals
+  if (q->sequence == snapshot_sequence) {
+    index_scheduler().wait_all_finish();
+  }
   auto tC = thresholdCounters.lookup(q->match_dist);
   if (q->match_type == MT_EDIT_DIST) {
     tC->edit--;
+    for (u32 i = 0; i < q->words_count; i++) {
+      u32 id = q->word_ids[i];
+      index_scheduler().submit_job(new remove_from_tree_job<entry>{
+          q, &dictionary().get(id), &edit_bk_tree()});
+      edit_log.remove(id);
+    }
+    edit_changed = true;
   } else if (q->match_type == MT_HAMMING_DIST) {
     tC->hamming--;
+    for (u32 i = 0; i < q->words_count; i++) {
+      u32 id = q->word_ids[i];
+      auto word = &dictionary().get(id);
+      index_scheduler().submit_job(new remove_from_tree_job<hamming_entry>{
+          q, word, &hamming_bk_trees()[word->size() - MIN_WORD_LENGTH]});
+      hamming_changed[word->size() - MIN_WORD_LENGTH] = true;
+      hamming_log.remove(id);
+    }
+  } else {
+    for (u32 i = 0; i < q->words_count; i++) {
+      index_scheduler().submit_job(
+          new remove_from_hash_table_job{q, q->word_ids[i], &exact()});
+    }
+    exact_changed = true;
   }
+  // In-flight documents keep seeing the query through their snapshot
   q->active = false;
+  free_slots.push(q->slot);
+  ended_queries.push(std::move(*i));
+  queries.remove(query_id);
+  index_changed = true;
   return EC_SUCCESS;
 }
 
-static void add_query_to_doc_results(
-    qs::thread_safe_container<qs::hash_table<QueryID, QueryResult>> &trt,
-    Query *q, qs::string_view *word) {
-  auto rt = trt.lock();
-  auto iter = rt->lookup(q->id);
-  if (iter == rt->end()) {
-    auto queryRes = QueryResult{};
-    queryRes.query = q;
-    queryRes.matched_words.insert(*word);
-    rt->insert(q->id, std::move(queryRes));
-    iter = rt->lookup(q->id);
+// Sets the bit of the matched word in the slot of the query. The job that
+// sets the last missing bit records the query
+static void add_match(DocumentResults *docRes, const Posting &p) {
+  auto before = docRes->matched_words[p.slot].fetch_or(
+      p.word_bit, std::memory_order_relaxed);
+  if (before != p.all_words && (before | p.word_bit) == p.all_words) {
+    auto i = docRes->matched_count.fetch_add(1, std::memory_order_relaxed);
+    docRes->matched_queries[i] = p.id;
+  }
+}
+
+// A document word and the type of the index it was matched against. The word
+// is packed so the key owns it and it can be handed to the SIMD hamming kernel
+// as is
+struct MatchCacheKey {
+  qs::packed_word word;
+  MatchType match_type;
+
+  bool operator==(const MatchCacheKey &other) const {
+    return match_type == other.match_type && word == other.word;
+  }
+};
+
+struct MatchCacheKeyHash {
+  std::size_t operator()(const MatchCacheKey &key) const {
+    auto hash = std::hash<qs::string_view>{}(key.word.get_string_view());
+    return hash * 31 + key.match_type;
+  }
+};
+
+// An indexed word within the threshold of a search and its distance from the
+// document word
+struct WordMatch {
+  u32 id;
+  u32 distance;
+};
+
+// The indexed words within max_dist of a document word as of a vocabulary
+// generation, found through the snapshot with the given sequence
+struct CachedMatches {
+  u32 generation;
+  u32 sequence;
+  u32 max_dist;
+  qs::vector<WordMatch> matches;
+};
+
+using match_cache_shard = qs::thread_safe_container<
+    qs::hash_table<MatchCacheKey, CachedMatches, MatchCacheKeyHash>>;
+
+// Consecutive documents share most of their words so the tree searches of a
+// word are remembered across documents. The cache is shared by every
+// snapshot: an entry may hold words that are not in the trees of a newer
+// snapshot, and those are skipped when the IDs are resolved, but an entry of
+// a newer snapshot misses the words removed since and is not used by older
+// ones
+static match_cache_shard *match_cache() {
+  static match_cache_shard shards[MATCH_CACHE_SHARDS];
+  return shards;
+}
+
+static void store_matches(match_cache_shard *shard, const MatchCacheKey &key,
+                          u32 generation, u32 sequence, u32 max_dist,
+                          qs::vector<WordMatch> &matches) {
+  auto table = shard->lock();
+  auto iter = table->lookup(key);
+  if (iter != table->end()) {
+    // Keep the entry if it is at least as good as this one
+    if (iter->sequence < sequence || iter->max_dist < max_dist) {
+      iter->matches.clear();
+      for (auto &m : matches) {
+        iter->matches.push(m);
+      }
+      iter->generation = generation;
+      iter->sequence = sequence;
+      iter->max_dist = max_dist;
+    }
   } else {
-    if (iter->matched) {
-      trt.unlock();
-      return;
+    if (table->get_size() >= MATCH_CACHE_SHARD_CAPACITY) {
+      // clear() leaves the table without slots
+      table->clear();
+      *table = qs::hash_table<MatchCacheKey, CachedMatches, MatchCacheKeyHash>{
+          MATCH_CACHE_SHARD_CAPACITY};
+    }
+    auto copy = qs::vector<WordMatch>{matches.get_size() + 2};
+    for (auto &m : matches) {
+      copy.push(m);
+    }
+    table->insert(key, CachedMatches{generation, sequence, max_dist,
+                                     std::move(copy)});
+  }
+  shard->unlock();
+}
+
+// A word that was removed and added again is in the log twice
+static bool has_match(qs::vector<WordMatch> &matches, u32 id) {
+  for (auto &m : matches) {
+    if (m.id == id) {
+      return true;
     }
-    iter->matched_words.insert(*word);
   }
-  if (iter->matched_words.get_size() == q->unique_words.get_size()) {
-    iter->matched = true;
-    iter->matched_words.clear();
+  return false;
+}
+
+// The words of index that are within max_dist of key.word, with their
+// distances, so the queries of every threshold are served by one search. A
+// cache entry of an older generation is brought up to date with the words
+// that were added to the index since, a miss or an entry for a smaller
+// max_dist searches the tree. The returned vector is reused by the next call
+// on the same thread
+template <typename E>
+static qs::vector<WordMatch> &cached_matches(FlatIndex<E> *index,
+                                             const WordLog *log,
+                                             u32 generation, u32 sequence,
+                                             const MatchCacheKey &key,
+                                             u32 max_dist) {
+  static thread_local qs::vector<WordMatch> matches{64};
+  matches.clear();
+  auto shard = &match_cache()[MatchCacheKeyHash{}(key) % MATCH_CACHE_SHARDS];
+  bool found = false;
+  u32 cached_generation = 0;
+  {
+    auto table = shard->lock();
+    auto iter = table->lookup(key);
+    if (iter != table->end() && iter->max_dist >= max_dist &&
+        iter->sequence <= sequence) {
+      found = true;
+      cached_generation = iter->generation;
+      // A bigger max_dist is kept so the entry stays valid for it
+      max_dist = iter->max_dist;
+      for (auto &m : iter->matches) {
+        matches.push(m);
+      }
+    }
+    shard->unlock();
+  }
+  if (found && cached_generation >= generation) {
+    qs::metrics::add(core_metrics.cache_hits);
+    return matches;
+  }
+
+  auto word = key.word.get_string_view();
+  auto threshold = (int)max_dist;
+  u32 added = generation - cached_generation;
+  if (found && (std::size_t)added * MATCH_CACHE_DELTA_RATIO <=
+                   index->get_size()) {
+    qs::metrics::add(core_metrics.cache_deltas);
+    u64 distance_calls = 0;
+    auto dist = index->get_distance_function();
+    for (u32 i = cached_generation; i < generation; i++) {
+      u32 id = (*log)[i];
+      auto &candidate = dictionary().get(id);
+      // Hamming needs equal lengths and the edit distance is at least the
+      // difference of the lengths
+      int length_diff = (int)candidate.size() - (int)word.size();
+      if (key.match_type == MT_HAMMING_DIST
+              ? length_diff != 0
+              : length_diff > threshold || -length_diff > threshold) {
+        continue;
+      }
+      int d = (*dist)(candidate.get_string_view(), word);
+      distance_calls++;
+      if (d <= threshold && !has_match(matches, id)) {
+        matches.push(WordMatch{id, (u32)d});
+      }
+    }
+    qs::metrics::add(core_metrics.distance_calls, distance_calls);
+  } else {
+    qs::metrics::add(core_metrics.cache_misses);
+    matches.clear();
+    u64 start = qs::metrics::start();
+    qs::filter_stats filters{};
+    auto distance_calls = index->traverse(
+        threshold, key.word,
+        [](E *e, int d) { matches.push(WordMatch{e->id, (u32)d}); },
+        &filters);
+    qs::metrics::record_since(core_metrics.traverse, start);
+    qs::metrics::add(core_metrics.distance_calls, distance_calls);
+    qs::metrics::add(core_metrics.filter_checks, filters.checked);
+    qs::metrics::add(core_metrics.filter_rejects, filters.rejected);
   }
-  trt.unlock();
+  store_matches(shard, key, generation, sequence, max_dist, matches);
+  return matches;
 }
 
-static void *match_queries(ts_bk_tree *index, qs::string_view *w,
-                           DocumentResults *docRes, MatchType match_type) {
-  for (auto iter = thresholdCounters.begin(); iter != thresholdCounters.end();
-       ++iter) {
-    if ((match_type == MT_EDIT_DIST && iter->edit == 0) ||
-        (match_type == MT_HAMMING_DIST && iter->hamming == 0)) {
+template <typename E>
+static void *match_queries(FlatIndex<E> *index, const WordLog *log,
+                           u32 generation, u32 sequence,
+                           qs::vector<ThresholdSnapshot> *thresholds,
+                           const qs::packed_word *w, DocumentResults *docRes,
+                           MatchType match_type) {
+  // One search with the biggest threshold that has queries of this type
+  bool has_queries = false;
+  u32 max_dist = 0;
+  for (auto &threshold : *thresholds) {
+    if ((match_type == MT_EDIT_DIST && threshold.counters.edit == 0) ||
+        (match_type == MT_HAMMING_DIST && threshold.counters.hamming == 0)) {
+      continue;
+    }
+    has_queries = true;
+    if (threshold.match_dist > max_dist) {
+      max_dist = threshold.match_dist;
+    }
+  }
+  if (!has_queries) {
+    return nullptr;
+  }
+  auto key = MatchCacheKey{*w, match_type};
+  for (auto &m : cached_matches(index, log, generation, sequence, key,
+                                     max_dist)) {
+    auto found = index->by_id.lookup(m.id);
+    if (found == index->by_id.end()) {
       continue;
     }
-    auto t = index->get_data();
-    auto matchedWords = t->match((int)iter.key(), *w);
-    for (auto &mw : matchedWords) {
-      for (auto mq : mw->payload) {
-        if (mq->active && iter.key() == mq->match_dist) {
-          add_query_to_doc_results(docRes->results, mq, &mw->word);
-        }
+    // A word at distance d matches every query with a threshold of at least d
+    auto &payload = (*found)->payload;
+    for (auto p = payload.cbegin(); p != payload.cend(); ++p) {
+      if (p->match_dist >= m.distance) {
+        add_match(docRes, *p);
       }
     }
   }
   return nullptr;
 }
 
-static void *match_exact(ts_hash_table *e, qs::string_view *w,
+static void *match_exact(exact_table *ht, const qs::packed_word *w,
                          DocumentResults *docRes) {
-  auto ht = e->get_data();
-  auto match = ht->lookup(*w);
+  auto match = ht->lookup(w->get_string_view());
   if (match != ht->end()) {
-    for (auto exactRes : *match) {
-      if (exactRes->active) {
-        add_query_to_doc_results(docRes->results, exactRes, &match.key());
-      }
+    for (auto &p : match->payload) {
+      add_match(docRes, p);
     }
   }
   return nullptr;
 }
-struct match_queries_job : public qs::job {
-
-  ts_bk_tree *index;
-  qs::string_view *w;
+// Matches a range of the unique words of a document against every index. The
+// words are grouped so a document fans out to a handful of jobs instead of
+// three jobs per word
+struct match_words_job : public qs::job {
+  IndexSnapshot *snapshot;
+  const qs::packed_word *begin;
+  const qs::packed_word *end;
   DocumentResults *docRes;
-  MatchType match_type;
 
-  match_queries_job(ts_bk_tree *index, qs::string_view *w,
-                    DocumentResults *docRes, MatchType match_type)
-      : index{index}, w{w}, docRes{docRes}, match_type{match_type} {}
+  match_words_job(IndexSnapshot *snapshot, const qs::packed_word *begin,
+                  const qs::packed_word *end, DocumentResults *docRes)
+      : snapshot{snapshot}, begin{begin}, end{end}, docRes{docRes} {}
 
-  void operator()() override { match_queries(index, w, docRes, match_type); }
+  void operator()() override {
+    auto thresholds = &snapshot->thresholds;
+    for (auto w = begin; w != end; w++) {
+      match_queries(snapshot->edit.get(), &edit_log,
+                    snapshot->edit_generation, snapshot->sequence, thresholds,
+                    w, docRes, MT_EDIT_DIST);
+      match_queries(snapshot->hamming[w->size() - MIN_WORD_LENGTH].get(),
+                    &hamming_log, snapshot->hamming_generation,
+                    snapshot->sequence, thresholds, w, docRes,
+                    MT_HAMMING_DIST);
+      match_exact(snapshot->exact.get(), w, docRes);
+    }
+  }
 };
 
-struct match_exact_job : public qs::job {
-  ts_hash_table *e;
-  qs::string_view *w;
-  DocumentResults *docRes;
-
-  match_exact_job(ts_hash_table *e, qs::string_view *w, DocumentResults *docRes)
-      : e{e}, w{w}, docRes{docRes} {}
-
-  void operator()() override { match_exact(e, w, docRes); }
+#ifdef QS_ROUND_ROBIN_SCHEDULER
+// The round robin scheduler can not wait for nested jobs without risking a
+// deadlock so the words run on the worker that matches the document
+struct match_task_group {
+  explicit match_task_group(core_scheduler &) {}
+  void spawn(qs::job *j) {
+    (*j)();
+    delete j;
+  }
+  void wait() {}
 };
+#else
+using match_task_group = qs::task_group;
+#endif
 
 static int comp(const void *a, const void *b) {
   return *(QueryID *)a > *(QueryID *)b;
 }
-void match_doc(
-    ts_bk_tree *ed, ts_bk_tree *h, ts_hash_table *ex,
-    qs::thread_safe_container<qs::linked_list<DocumentResults>> *doc_res,
-    qs::list_node<DocumentResults> *res,
-    qs::concurrent_queue<DocumentResults> *fin_res) {
-  qs::scheduler s{3};
-  auto &&r = res->get();
-  for (auto &w : r.words) {
-    s.submit_job(new match_queries_job(ed, &w, &r, MT_EDIT_DIST));
-    s.submit_job(new match_queries_job(&h[w.size() - MIN_WORD_LENGTH], &w, &r,
-                                       MT_HAMMING_DIST));
-    s.submit_job(new match_exact_job(ex, &w, &r));
-  }
-  s.wait_all_finish();
-  r.answer_len = 0;
-  r.answer = static_cast<QueryID *>(
-      malloc(sizeof(QueryID) * r.results.get_data()->get_size()));
-  for (auto &qRes : *r.results.get_data()) {
-    if (qRes.matched) {
-      r.answer[r.answer_len++] = qRes.query->id;
-    }
-  }
-  qsort(r.answer, r.answer_len, sizeof(QueryID), &comp);
-  fin_res->enqueue(std::move(r));
-  doc_res->lock()->remove(res);
-  doc_res->unlock();
+void match_doc(IndexSnapshot *snapshot, DocumentResults *r,
+               qs::mpmc_queue<FinishedDocument> *fin_res, u64 submitted) {
+  if (r->owned_doc != nullptr) {
+    qs::metrics::scoped_timer timer{core_metrics.parse};
+    ingest_document(r, r->owned_doc, std::strlen(r->owned_doc));
+    std::free(r->owned_doc);
+    r->owned_doc = nullptr;
+  }
+  {
+    qs::metrics::scoped_timer timer{core_metrics.words};
+    // The document job already runs on a worker of job_scheduler so the words
+    // are spawned on the same pool and this worker helps while it waits
+    match_task_group group{job_scheduler()};
+    auto words_p = r->words;
+    std::size_t words_count = r->words_count;
+    for (std::size_t i = 0; i < words_count; i += MATCH_WORDS_PER_JOB) {
+      std::size_t end = i + MATCH_WORDS_PER_JOB;
+      if (end > words_count) {
+        end = words_count;
+      }
+      group.spawn(
+          new match_words_job{snapshot, words_p + i, words_p + end, r});
+    }
+    group.wait();
+  }
+  static thread_local AnswerArena answers;
+  std::size_t matched = r->matched_count.load(std::memory_order_relaxed);
+  FinishedDocument finished{r->docId, matched, nullptr, nullptr};
+  if (matched > 0) {
+    qs::metrics::scoped_timer timer{core_metrics.answer};
+    finished.answer = answers.allocate(matched, &finished.block);
+    std::memcpy(finished.answer, r->matched_queries, sizeof(QueryID) * matched);
+    qsort(finished.answer, matched, sizeof(QueryID), &comp);
+  }
+  qs::metrics::add(core_metrics.answers, matched);
+  qs::metrics::record_since(core_metrics.total, submitted);
+  fin_res->enqueue(finished);
+  auto arena = r->arena;
+  r->~DocumentResults();
+  give_back_document_arena(arena);
 }
 
 struct match_doc_job : public qs::job {
-  ts_bk_tree *ed;
-  ts_bk_tree *h;
-  ts_hash_table *ex;
-  qs::thread_safe_container<qs::linked_list<DocumentResults>> *doc_res;
-  qs::list_node<DocumentResults> *res;
-  qs::concurrent_queue<DocumentResults> *fin_res;
-
-  match_doc_job(
-      ts_bk_tree *ed, ts_bk_tree *h, ts_hash_table *ex,
-      qs::thread_safe_container<qs::linked_list<DocumentResults>> *doc_res,
-      qs::list_node<DocumentResults> *res,
-      qs::concurrent_queue<DocumentResults> *fin_res)
-      : ed{ed}, h{h}, ex{ex}, doc_res{doc_res}, res{res}, fin_res{fin_res} {}
-
-  void operator()() override { match_doc(ed, h, ex, doc_res, res, fin_res); }
+  // Keeps the snapshot alive until the job is deleted
+  qs::shared_pointer<IndexSnapshot> snapshot;
+  DocumentResults *res;
+  qs::mpmc_queue<FinishedDocument> *fin_res;
+  // When MatchDocument submitted the job, 0 if metrics are disabled
+  u64 submitted;
+
+  match_doc_job(const qs::shared_pointer<IndexSnapshot> &snapshot,
+                DocumentResults *res, qs::mpmc_queue<FinishedDocument> *fin_res)
+      : snapshot{snapshot}, res{res}, fin_res{fin_res},
+        submitted{qs::metrics::start()} {}
+
+  void operator()() override {
+    qs::metrics::record_since(core_metrics.queued, submitted);
+    match_doc(snapshot.get(), res, fin_res, submitted);
+  }
 };
 
-qs::concurrent_queue<DocumentResults> finished_results{};
-qs::thread_safe_container<qs::linked_list<DocumentResults>> docs{};
+qs::mpmc_queue<FinishedDocument> finished_results{FINISHED_RESULTS_CAPACITY};
+// Documents that have been submitted but not returned by GetNextAvailRes or
+// GetNextAvailResBatch
+static std::atomic<std::size_t> pending_documents{0};
 
-ErrorCode MatchDocument(DocID doc_id, const char *doc_str) {
-  if (query_has_started) {
-    job_scheduler().wait_all_finish();
-    query_has_started = false;
-  }
-  auto d = docs.lock();
-  d->append(DocumentResults{doc_id, active_queries / 2, doc_str});
-  auto res_node = d->tail;
-  auto &&res = res_node->get();
-  docs.unlock();
-  qs::parse_string(res.doc_str.data(), ' ',
-                   [&](qs::string_view &word) { res.words.insert(word); });
+// Parses doc_str before returning unless the document is owned, in which case
+// the job parses it
+static ErrorCode submit_document(DocID doc_id, const char *doc_str,
+                                 char *owned_doc) {
+  if (index_changed) {
+    qs::metrics::scoped_timer timer{core_metrics.publish};
+    index_scheduler().wait_all_finish();
+    publish_snapshot();
+  }
+  u64 start = qs::metrics::start();
+  pending_documents.fetch_add(1);
+  auto arena = take_document_arena();
+  auto res = arena->make<DocumentResults>(arena, doc_id,
+                                          current_snapshot->query_slots);
+  if (owned_doc == nullptr) {
+    ingest_document(res, doc_str, std::strlen(doc_str));
+    qs::metrics::record_since(core_metrics.parse, start);
+  } else {
+    res->owned_doc = owned_doc;
+  }
+  if (qs::metrics::enabled()) {
+    qs::metrics::add(core_metrics.documents);
+    qs::metrics::record(core_metrics.pending_jobs,
+                        job_scheduler().get_pending_jobs());
+  }
   job_scheduler().submit_job(
-      new match_doc_job{&edit_bk_tree(), hamming_bk_trees(), &exact(), &docs,
-                        res_node, &finished_results});
+      new match_doc_job{current_snapshot, res, &finished_results});
   return EC_SUCCESS;
 }
+
+ErrorCode MatchDocument(DocID doc_id, const char *doc_str) {
+  return submit_document(doc_id, doc_str, nullptr);
+}
+
+ErrorCode MatchDocumentOwned(DocID doc_id, char *doc_str) {
+  return submit_document(doc_id, doc_str, doc_str);
+}
+
 ErrorCode GetNextAvailRes(DocID *p_doc_id, unsigned int *p_num_res,
                           QueryID **p_query_ids) {
-  DocumentResults *d_res = finished_results.peek();
-  if (d_res == nullptr) {
+  if (pending_documents.load() == 0) {
+    return EC_NO_AVAIL_RES;
+  }
+  u64 start = qs::metrics::start();
+  auto d_res = finished_results.dequeue();
+  qs::metrics::record_since(core_metrics.wait, start);
+  if (d_res.is_empty()) {
+    return EC_NO_AVAIL_RES;
+  }
+  pending_documents.fetch_sub(1);
+  auto &&finished = d_res.get();
+  *p_doc_id = finished.docId;
+  *p_num_res = finished.answer_len;
+  *p_query_ids = nullptr;
+  if (finished.answer_len > 0) {
+    // The benchmark frees the array so it has to come from malloc
+    std::size_t bytes = sizeof(QueryID) * finished.answer_len;
+    *p_query_ids = static_cast<QueryID *>(malloc(bytes));
+    std::memcpy(*p_query_ids, finished.answer, bytes);
+    finished.block->release();
+  }
+  return EC_SUCCESS;
+}
+
+// The blocks of the answers handed out by the last GetNextAvailResBatch call
+static qs::vector<AnswerBlock *> batch_blocks{64};
+
+ErrorCode GetNextAvailResBatch(DocResult *results, unsigned int max_docs,
+                               unsigned int *p_num_docs) {
+  for (auto block : batch_blocks) {
+    block->release();
+  }
+  batch_blocks.clear();
+  *p_num_docs = 0;
+  if (max_docs == 0 || pending_documents.load() == 0) {
     return EC_NO_AVAIL_RES;
   }
-  *p_doc_id = d_res->docId;
-  *p_num_res = d_res->answer_len;
-  *p_query_ids = d_res->answer;
-  finished_results.dequeue(nullptr);
+  // Block for the first document only and take whatever else is ready
+  u64 start = qs::metrics::start();
+  auto first = finished_results.dequeue();
+  qs::metrics::record_since(core_metrics.wait, start);
+  if (first.is_empty()) {
+    return EC_NO_AVAIL_RES;
+  }
+  FinishedDocument finished = first.get();
+  do {
+    results[*p_num_docs] =
+        DocResult{finished.docId, (unsigned int)finished.answer_len,
+                  finished.answer};
+    (*p_num_docs)++;
+    if (finished.block != nullptr) {
+      batch_blocks.push(finished.block);
+    }
+  } while (*p_num_docs < max_docs &&
+           finished_results.try_dequeue(finished));
+  pending_documents.fetch_sub(*p_num_docs);
+  return EC_SUCCESS;
+}
+
+ErrorCode EnableMetrics(int enabled) {
+#ifdef QS_METRICS_DISABLED
+  return enabled ? EC_FAIL : EC_SUCCESS;
+#else
+  qs::metrics::set_enabled(enabled != 0);
   return EC_SUCCESS;
+#endif
+}
+
+ErrorCode ResetMetrics() {
+  qs::metrics::reset();
+  return EC_SUCCESS;
+}
+
+ErrorCode DumpMetrics(int fd) {
+  qs::metrics::dump(fd);
+  return EC_SUCCESS;
+}
+
+ErrorCode DumpMetricsOnSignal(int signum, int fd) {
+  return qs::metrics::dump_on_signal(signum, fd) ? EC_SUCCESS : EC_FAIL;
 }
@@ -1,8 +1,14 @@
 #include <qs/distances.hpp>
 
 #include <qs/core.h>
+#include <qs/packed_word.h>
 #include <qs/string_view.h>
 
+#if defined(__x86_64__) || defined(__i386__)
+#define QS_X86
+#include <immintrin.h>
+#endif
+
 namespace qs {
 
 int hamming_distance(qs::string_view s1, qs::string_view s2) {
@@ -22,6 +28,105 @@ int hamming_distance(qs::string_view s1, qs::string_view s2) {
   return dist;
 }
 
+// Counts the non zero bytes of a 64 bit word
+static QS_FORCE_INLINE int count_nonzero_bytes(u64 x) {
+  const u64 low7 = 0x7f7f7f7f7f7f7f7full;
+  u64 t = ((x & low7) + low7) | x;
+  return __builtin_popcountll(t & ~low7);
+}
+
+static int packed_hamming_scalar(const char *a, const char *b) {
+  int dist = 0;
+  for (int i = 0; i < QS_PACKED_WORD_SIZE; i += 8) {
+    u64 x, y;
+    std::memcpy(&x, a + i, 8);
+    std::memcpy(&y, b + i, 8);
+    dist += count_nonzero_bytes(x ^ y);
+  }
+  return dist;
+}
+
+#ifdef QS_X86
+__attribute__((target("sse4.2,popcnt"))) static int
+packed_hamming_sse42(const char *a, const char *b) {
+  __m128i a0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a));
+  __m128i a1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + 16));
+  __m128i b0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b));
+  __m128i b1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + 16));
+  u32 eq = (u32)_mm_movemask_epi8(_mm_cmpeq_epi8(a0, b0)) |
+           ((u32)_mm_movemask_epi8(_mm_cmpeq_epi8(a1, b1)) << 16);
+  return _mm_popcnt_u32(~eq);
+}
+
+__attribute__((target("avx2,popcnt"))) static int
+packed_hamming_avx2(const char *a, const char *b) {
+  __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a));
+  __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b));
+  u32 eq = (u32)_mm256_movemask_epi8(_mm256_cmpeq_epi8(va, vb));
+  return _mm_popcnt_u32(~eq);
+}
+#endif
+
+// Scores one word against a contiguous block of words. Each ISA gets its own
+// loop so the kernel is inlined instead of called through a pointer.
+#define QS_PACKED_HAMMING_BATCH(name, kernel)                                  \
+  static void name(const char *w, const packed_word *words, std::size_t n,    \
+                   int *out) {                                                 \
+    for (std::size_t i = 0; i < n; i++) {                                      \
+      out[i] = kernel(w, words[i].data);                                       \
+    }                                                                          \
+  }
+
+QS_PACKED_HAMMING_BATCH(packed_hamming_batch_scalar, packed_hamming_scalar)
+#ifdef QS_X86
+__attribute__((target("sse4.2,popcnt")))
+QS_PACKED_HAMMING_BATCH(packed_hamming_batch_sse42, packed_hamming_sse42)
+__attribute__((target("avx2,popcnt")))
+QS_PACKED_HAMMING_BATCH(packed_hamming_batch_avx2, packed_hamming_avx2)
+#endif
+
+struct packed_hamming_kernels {
+  int (*single)(const char *, const char *);
+  void (*batch)(const char *, const packed_word *, std::size_t, int *);
+};
+
+static packed_hamming_kernels select_packed_hamming_kernels() {
+#ifdef QS_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return {&packed_hamming_avx2, &packed_hamming_batch_avx2};
+  }
+  if (__builtin_cpu_supports("sse4.2") && __builtin_cpu_supports("popcnt")) {
+    return {&packed_hamming_sse42, &packed_hamming_batch_sse42};
+  }
+#endif
+  return {&packed_hamming_scalar, &packed_hamming_batch_scalar};
+}
+
+static QS_FORCE_INLINE const packed_hamming_kernels &packed_hamming() {
+  static const packed_hamming_kernels kernels =
+      select_packed_hamming_kernels();
+  return kernels;
+}
+
+int packed_hamming_distance(const packed_word &w1, const packed_word &w2) {
+  return packed_hamming().single(w1.data, w2.data);
+}
+
+int packed_hamming_distance(qs::string_view s1, qs::string_view s2) {
+  if (s1.size() != s2.size()) {
+    throw std::runtime_error("cannot find hamming distance between two strings "
+                             "of different lengths");
+  }
+  return packed_hamming().single(s1.data(), s2.data());
+}
+
+void packed_hamming_distance_batch(const packed_word &w,
+                                   const packed_word *words, std::size_t n,
+                                   int *out) {
+  packed_hamming().batch(w.data, words, n, out);
+}
+
 static QS_FORCE_INLINE void init_edit_buffer(int *buffer, int len) {
   for (int i = 0; i < len; i++) {
     buffer[i] = i;
@@ -78,4 +183,107 @@ int edit_distance(qs::string_view s1, qs::string_view s2) {
 
   return d[max_len];
 }
+
+// Strips the common prefix and suffix of the two strings and orders them so
+// that the pattern is the shorter one. Returns false if the pattern is empty.
+static QS_FORCE_INLINE bool trim_edit_operands(qs::string_view s1,
+                                               qs::string_view s2,
+                                               const char *&pattern, int &m,
+                                               const char *&text, int &n) {
+  n = (int)s1.size();
+  text = s1.data();
+  m = (int)s2.size();
+  pattern = s2.data();
+  if (n < m) {
+    functions::swap(n, m);
+    functions::swap(text, pattern);
+  }
+  while (m > 0 && *text == *pattern) {
+    text++;
+    pattern++;
+    n--;
+    m--;
+  }
+  while (m > 0 && text[n - 1] == pattern[m - 1]) {
+    n--;
+    m--;
+  }
+  return m > 0;
+}
+
+// Myers/Hyyrö bit-vector Levenshtein distance. The pattern must fit in a
+// single machine word. The column of the DP matrix is encoded as vertical
+// positive/negative deltas (vp/vn) and the score is tracked on the last row.
+// If the score can no longer drop to max_dist the computation stops and
+// max_dist + 1 is returned.
+static QS_FORCE_INLINE int myers_edit_distance(const char *pattern, int m,
+                                               const char *text, int n,
+                                               int max_dist) {
+  u64 peq[256];
+  for (int i = 0; i < n; i++) {
+    peq[(u8)text[i]] = 0;
+  }
+  for (int i = 0; i < m; i++) {
+    peq[(u8)pattern[i]] = 0;
+  }
+  for (int i = 0; i < m; i++) {
+    peq[(u8)pattern[i]] |= (u64)1 << i;
+  }
+
+  u64 vp = ~(u64)0;
+  u64 vn = 0;
+  const u64 last = (u64)1 << (m - 1);
+  int score = m;
+
+  for (int j = 0; j < n; j++) {
+    u64 x = peq[(u8)text[j]] | vn;
+    u64 d0 = (((x & vp) + vp) ^ vp) | x;
+    u64 hp = vn | ~(d0 | vp);
+    u64 hn = d0 & vp;
+    score += (int)((hp & last) != 0) - (int)((hn & last) != 0);
+    // Every remaining column can lower the score by at most one
+    if (score - (n - j - 1) > max_dist) {
+      return max_dist + 1;
+    }
+    hp = (hp << 1) | 1;
+    hn = hn << 1;
+    vp = hn | ~(d0 | hp);
+    vn = hp & d0;
+  }
+
+  return score;
+}
+
+int bit_parallel_edit_distance(qs::string_view s1, qs::string_view s2) {
+  const char *pattern;
+  const char *text;
+  int m, n;
+  if (!trim_edit_operands(s1, s2, pattern, m, text, n)) {
+    return n;
+  }
+  if (m > 64) {
+    return edit_distance(string_view{pattern, pattern + m - 1},
+                         string_view{text, text + n - 1});
+  }
+  return myers_edit_distance(pattern, m, text, n, n);
+}
+
+int bounded_edit_distance(qs::string_view s1, qs::string_view s2,
+                          int max_dist) {
+  const char *pattern;
+  const char *text;
+  int m, n;
+  if (!trim_edit_operands(s1, s2, pattern, m, text, n)) {
+    return n <= max_dist ? n : max_dist + 1;
+  }
+  if (n - m > max_dist) {
+    return max_dist + 1;
+  }
+  if (m > 64) {
+    int d = edit_distance(string_view{pattern, pattern + m - 1},
+                          string_view{text, text + n - 1});
+    return d <= max_dist ? d : max_dist + 1;
+  }
+  return myers_edit_distance(pattern, m, text, n, max_dist);
+}
 } // namespace qs
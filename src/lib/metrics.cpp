@@ -0,0 +1,326 @@
+#include <qs/metrics.hpp>
+
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <pthread.h>
+#include <stdexcept>
+#include <unistd.h>
+
+namespace qs {
+namespace metrics {
+
+#define QS_HISTOGRAM_SUB (1u << QS_HISTOGRAM_SUB_BITS)
+// The buckets of a histogram followed by the sum and the max of its values
+#define QS_HISTOGRAM_SUM QS_HISTOGRAM_BUCKETS
+#define QS_HISTOGRAM_MAX (QS_HISTOGRAM_BUCKETS + 1)
+#define QS_HISTOGRAM_CELLS (QS_HISTOGRAM_BUCKETS + 2)
+
+std::atomic<bool> enabled_flag{false};
+
+namespace {
+
+// The metrics of one thread. Blocks are never freed so the counts of threads
+// that exit are kept
+struct alignas(QS_CACHE_LINE_SIZE) thread_block {
+  std::atomic<u64> counters[QS_METRICS_MAX_COUNTERS];
+  // Allocated the first time the thread records a value in the histogram
+  std::atomic<std::atomic<u64> *> histograms[QS_METRICS_MAX_HISTOGRAMS];
+};
+
+pthread_mutex_t registry_mutex = PTHREAD_MUTEX_INITIALIZER;
+char counter_names[QS_METRICS_MAX_COUNTERS][QS_METRICS_MAX_NAME];
+char histogram_names[QS_METRICS_MAX_HISTOGRAMS][QS_METRICS_MAX_NAME];
+std::atomic<u32> counters_count{0};
+std::atomic<u32> histograms_count{0};
+
+std::atomic<thread_block *> blocks[QS_METRICS_MAX_THREADS];
+std::atomic<u32> blocks_count{0};
+// Used by the threads that did not get a block of their own
+thread_block shared_block;
+
+thread_local thread_block *local = nullptr;
+
+thread_block *local_block() {
+  if (local != nullptr) {
+    return local;
+  }
+  u32 index = blocks_count.fetch_add(1, std::memory_order_relaxed);
+  if (index < QS_METRICS_MAX_THREADS) {
+    local = new thread_block{};
+    blocks[index].store(local, std::memory_order_release);
+  } else {
+    local = &shared_block;
+  }
+  return local;
+}
+
+// Calls fn with every block that has been created so far
+template <typename Fn> void for_each_block(Fn fn) {
+  u32 count = blocks_count.load(std::memory_order_acquire);
+  if (count > QS_METRICS_MAX_THREADS) {
+    count = QS_METRICS_MAX_THREADS;
+  }
+  for (u32 i = 0; i < count; i++) {
+    auto block = blocks[i].load(std::memory_order_acquire);
+    if (block != nullptr) {
+      fn(block);
+    }
+  }
+  fn(&shared_block);
+}
+
+u32 register_name(char (*names)[QS_METRICS_MAX_NAME], std::atomic<u32> &count,
+                  u32 capacity, const char *name) {
+  pthread_mutex_lock(&registry_mutex);
+  u32 n = count.load(std::memory_order_relaxed);
+  for (u32 i = 0; i < n; i++) {
+    if (std::strncmp(names[i], name, QS_METRICS_MAX_NAME - 1) == 0) {
+      pthread_mutex_unlock(&registry_mutex);
+      return i;
+    }
+  }
+  if (n == capacity) {
+    pthread_mutex_unlock(&registry_mutex);
+    throw std::runtime_error("the metrics registry is full");
+  }
+  std::strncpy(names[n], name, QS_METRICS_MAX_NAME - 1);
+  count.store(n + 1, std::memory_order_release);
+  pthread_mutex_unlock(&registry_mutex);
+  return n;
+}
+
+u32 bucket_of(u64 value) {
+  if (value < QS_HISTOGRAM_SUB) {
+    return (u32)value;
+  }
+  u32 msb = 63 - __builtin_clzll(value);
+  if (msb >= QS_HISTOGRAM_MAX_BITS) {
+    return QS_HISTOGRAM_BUCKETS - 1;
+  }
+  u32 shift = msb - QS_HISTOGRAM_SUB_BITS;
+  return ((shift + 1) << QS_HISTOGRAM_SUB_BITS) +
+         (u32)((value >> shift) & (QS_HISTOGRAM_SUB - 1));
+}
+
+// The biggest value that falls in bucket
+u64 bucket_value(u32 bucket) {
+  if (bucket < QS_HISTOGRAM_SUB) {
+    return bucket;
+  }
+  u32 shift = (bucket >> QS_HISTOGRAM_SUB_BITS) - 1;
+  u64 lower = (u64)(QS_HISTOGRAM_SUB + (bucket & (QS_HISTOGRAM_SUB - 1)))
+              << shift;
+  return lower + (1ull << shift) - 1;
+}
+
+std::atomic<u64> *histogram_cells(thread_block *block, histogram h) {
+  auto cells = block->histograms[h.id].load(std::memory_order_acquire);
+  if (cells != nullptr) {
+    return cells;
+  }
+  auto fresh = new std::atomic<u64>[QS_HISTOGRAM_CELLS]();
+  // Only the shared block can race here
+  if (!block->histograms[h.id].compare_exchange_strong(
+          cells, fresh, std::memory_order_acq_rel)) {
+    delete[] fresh;
+    return cells;
+  }
+  return fresh;
+}
+
+// Sums the cells of h over every thread, the max is the biggest of them.
+// cells must hold QS_HISTOGRAM_CELLS values
+void collect(histogram h, u64 *cells) {
+  for (u32 i = 0; i < QS_HISTOGRAM_CELLS; i++) {
+    cells[i] = 0;
+  }
+  for_each_block([h, cells](thread_block *block) {
+    auto src = block->histograms[h.id].load(std::memory_order_acquire);
+    if (src == nullptr) {
+      return;
+    }
+    for (u32 i = 0; i < QS_HISTOGRAM_MAX; i++) {
+      cells[i] += src[i].load(std::memory_order_relaxed);
+    }
+    u64 max = src[QS_HISTOGRAM_MAX].load(std::memory_order_relaxed);
+    if (max > cells[QS_HISTOGRAM_MAX]) {
+      cells[QS_HISTOGRAM_MAX] = max;
+    }
+  });
+}
+
+histogram_summary summarize(const u64 *cells) {
+  histogram_summary s{};
+  for (u32 i = 0; i < QS_HISTOGRAM_BUCKETS; i++) {
+    s.count += cells[i];
+  }
+  s.sum = cells[QS_HISTOGRAM_SUM];
+  s.max = cells[QS_HISTOGRAM_MAX];
+  // The value of the first bucket that reaches the rank of every percentile,
+  // in thousandths
+  const u32 per_mille[] = {500, 900, 990, 999};
+  u64 *targets[] = {&s.p50, &s.p90, &s.p99, &s.p999};
+  u32 next = 0;
+  u64 seen = 0;
+  for (u32 i = 0; i < QS_HISTOGRAM_BUCKETS && next < 4; i++) {
+    seen += cells[i];
+    while (next < 4 && seen > 0 &&
+           seen * 1000 >= s.count * per_mille[next]) {
+      // The last bucket has no upper bound
+      u64 value = i == QS_HISTOGRAM_BUCKETS - 1 ? s.max : bucket_value(i);
+      *targets[next++] = value < s.max ? value : s.max;
+    }
+  }
+  return s;
+}
+
+// Formats into a fixed buffer and writes it with write(2) so it can run in
+// a signal handler
+class fd_writer {
+  int fd;
+  char buf[512];
+  std::size_t len = 0;
+
+public:
+  explicit fd_writer(int fd) : fd(fd) {}
+  fd_writer(const fd_writer &other) = delete;
+  ~fd_writer() { flush(); }
+
+  void flush() {
+    std::size_t done = 0;
+    while (done < len) {
+      ssize_t n = ::write(fd, buf + done, len - done);
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      if (n <= 0) {
+        break;
+      }
+      done += (std::size_t)n;
+    }
+    len = 0;
+  }
+
+  fd_writer &operator<<(const char *s) {
+    while (*s != '\0') {
+      if (len == sizeof(buf)) {
+        flush();
+      }
+      buf[len++] = *s++;
+    }
+    return *this;
+  }
+
+  fd_writer &operator<<(u64 value) {
+    char digits[21];
+    int i = sizeof(digits) - 1;
+    digits[i] = '\0';
+    do {
+      digits[--i] = (char)('0' + value % 10);
+      value /= 10;
+    } while (value > 0);
+    return *this << &digits[i];
+  }
+};
+
+int signal_fd = STDERR_FILENO;
+
+void dump_handler(int) {
+  int saved = errno;
+  dump(signal_fd);
+  errno = saved;
+}
+
+} // namespace
+
+counter register_counter(const char *name) {
+  return counter{register_name(counter_names, counters_count,
+                               QS_METRICS_MAX_COUNTERS, name)};
+}
+
+histogram register_histogram(const char *name) {
+  return histogram{register_name(histogram_names, histograms_count,
+                                 QS_METRICS_MAX_HISTOGRAMS, name)};
+}
+
+void set_enabled(bool enabled) {
+  enabled_flag.store(enabled, std::memory_order_relaxed);
+}
+
+void add_enabled(counter c, u64 n) {
+  local_block()->counters[c.id].fetch_add(n, std::memory_order_relaxed);
+}
+
+void record_enabled(histogram h, u64 value) {
+  auto cells = histogram_cells(local_block(), h);
+  cells[bucket_of(value)].fetch_add(1, std::memory_order_relaxed);
+  cells[QS_HISTOGRAM_SUM].fetch_add(value, std::memory_order_relaxed);
+  auto &max = cells[QS_HISTOGRAM_MAX];
+  u64 current = max.load(std::memory_order_relaxed);
+  while (value > current &&
+         !max.compare_exchange_weak(current, value, std::memory_order_relaxed))
+    ;
+}
+
+u64 get_counter(counter c) {
+  u64 sum = 0;
+  for_each_block([c, &sum](thread_block *block) {
+    sum += block->counters[c.id].load(std::memory_order_relaxed);
+  });
+  return sum;
+}
+
+histogram_summary get_histogram(histogram h) {
+  u64 cells[QS_HISTOGRAM_CELLS];
+  collect(h, cells);
+  return summarize(cells);
+}
+
+void reset() {
+  for_each_block([](thread_block *block) {
+    for (auto &c : block->counters) {
+      c.store(0, std::memory_order_relaxed);
+    }
+    for (auto &h : block->histograms) {
+      auto cells = h.load(std::memory_order_acquire);
+      if (cells == nullptr) {
+        continue;
+      }
+      for (u32 i = 0; i < QS_HISTOGRAM_CELLS; i++) {
+        cells[i].store(0, std::memory_order_relaxed);
+      }
+    }
+  });
+}
+
+void dump(int fd) {
+  fd_writer out{fd};
+  u32 counters = counters_count.load(std::memory_order_acquire);
+  for (u32 i = 0; i < counters; i++) {
+    out << "counter " << counter_names[i] << " " << get_counter(counter{i})
+        << "\n";
+  }
+  u32 histograms = histograms_count.load(std::memory_order_acquire);
+  for (u32 i = 0; i < histograms; i++) {
+    u64 cells[QS_HISTOGRAM_CELLS];
+    collect(histogram{i}, cells);
+    auto s = summarize(cells);
+    out << "histogram " << histogram_names[i] << " count=" << s.count
+        << " mean=" << (s.count > 0 ? s.sum / s.count : 0) << " p50=" << s.p50
+        << " p90=" << s.p90 << " p99=" << s.p99 << " p999=" << s.p999
+        << " max=" << s.max << "\n";
+  }
+}
+
+bool dump_on_signal(int signum, int fd) {
+  signal_fd = fd;
+  struct sigaction action {};
+  action.sa_handler = &dump_handler;
+  action.sa_flags = SA_RESTART;
+  sigemptyset(&action.sa_mask);
+  return sigaction(signum, &action, nullptr) == 0;
+}
+
+} // namespace metrics
+} // namespace qs
@@ -0,0 +1,90 @@
+#include <qs/parser.hpp>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define QS_X86
+#include <immintrin.h>
+#endif
+
+namespace qs {
+
+// Sets the high bit of every byte of x that is zero
+static QS_FORCE_INLINE u64 zero_bytes(u64 x) {
+  const u64 low7 = 0x7f7f7f7f7f7f7f7full;
+  return ~(((x & low7) + low7) | x | low7);
+}
+
+static void delimiter_masks_scalar(const char *data, std::size_t blocks,
+                                   char del, u64 *masks) {
+  const u64 spread = 0x0101010101010101ull * (u8)del;
+  for (std::size_t b = 0; b < blocks; b++) {
+    u64 mask = 0;
+    for (int i = 0; i < QS_PARSER_BLOCK; i += 8) {
+      u64 x;
+      std::memcpy(&x, data + b * QS_PARSER_BLOCK + i, 8);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+      x = __builtin_bswap64(x);
+#endif
+      // Gathers the high bits of the bytes in the low 8 bits, the byte at
+      // the lowest address first
+      u64 hits = (zero_bytes(x ^ spread) >> 7) * 0x0102040810204080ull >> 56;
+      mask |= hits << i;
+    }
+    masks[b] = mask;
+  }
+}
+
+#ifdef QS_X86
+__attribute__((target("sse2"))) static void
+delimiter_masks_sse2(const char *data, std::size_t blocks, char del,
+                     u64 *masks) {
+  __m128i needle = _mm_set1_epi8(del);
+  for (std::size_t b = 0; b < blocks; b++) {
+    u64 mask = 0;
+    for (int i = 0; i < QS_PARSER_BLOCK; i += 16) {
+      __m128i v = _mm_loadu_si128(
+          reinterpret_cast<const __m128i *>(data + b * QS_PARSER_BLOCK + i));
+      mask |= (u64)(u32)_mm_movemask_epi8(_mm_cmpeq_epi8(v, needle)) << i;
+    }
+    masks[b] = mask;
+  }
+}
+
+__attribute__((target("avx2"))) static void
+delimiter_masks_avx2(const char *data, std::size_t blocks, char del,
+                     u64 *masks) {
+  __m256i needle = _mm256_set1_epi8(del);
+  for (std::size_t b = 0; b < blocks; b++) {
+    auto block = data + b * QS_PARSER_BLOCK;
+    __m256i lo = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(block));
+    __m256i hi =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(block + 32));
+    masks[b] = (u64)(u32)_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, needle)) |
+               (u64)(u32)_mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, needle))
+                   << 32;
+  }
+}
+#endif
+
+using delimiter_masks_kernel = void (*)(const char *, std::size_t, char,
+                                        u64 *);
+
+static delimiter_masks_kernel select_delimiter_masks() {
+#ifdef QS_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return &delimiter_masks_avx2;
+  }
+  if (__builtin_cpu_supports("sse2")) {
+    return &delimiter_masks_sse2;
+  }
+#endif
+  return &delimiter_masks_scalar;
+}
+
+void delimiter_masks(const char *data, std::size_t blocks, char del,
+                     u64 *masks) {
+  static const delimiter_masks_kernel kernel = select_delimiter_masks();
+  kernel(data, blocks, del, masks);
+}
+
+} // namespace qs
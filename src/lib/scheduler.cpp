@@ -5,16 +5,83 @@
 
 namespace qs {
 
+worker::~worker() {
+  pthread_mutex_destroy(&mutex);
+  pthread_cond_destroy(&job_available);
+  pthread_cond_destroy(&drained);
+}
+
+void worker::enqueue(job *j) {
+  pending.fetch_add(1, std::memory_order_release);
+  QS_UNWRAP(pthread_mutex_lock(&mutex));
+  jobs.enqueue(j);
+  bool wake = parked;
+  QS_UNWRAP(pthread_mutex_unlock(&mutex));
+  // A worker that is running or still spinning will find the job on its own
+  if (wake) {
+    QS_UNWRAP(pthread_cond_signal(&job_available));
+  }
+}
+
+void worker::start() {
+  while (true) {
+    for (std::size_t spins = 0;
+         spins < spin_budget && pending.load(std::memory_order_acquire) == 0;
+         spins++) {
+      QS_CPU_RELAX();
+    }
+
+    QS_UNWRAP(pthread_mutex_lock(&mutex));
+    while (jobs.empty() && !closed) {
+      parked = true;
+      QS_UNWRAP(pthread_cond_wait(&job_available, &mutex));
+      parked = false;
+    }
+    auto next = jobs.dequeue();
+    QS_UNWRAP(pthread_mutex_unlock(&mutex));
+    if (next.is_empty()) {
+      break;
+    }
+
+    auto j = next.get();
+    (*j)();
+    delete j;
+    if (pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      QS_UNWRAP(pthread_mutex_lock(&mutex));
+      QS_UNWRAP(pthread_cond_broadcast(&drained));
+      QS_UNWRAP(pthread_mutex_unlock(&mutex));
+    }
+  }
+}
+
+void worker::stop() {
+  QS_UNWRAP(pthread_mutex_lock(&mutex));
+  closed = true;
+  QS_UNWRAP(pthread_mutex_unlock(&mutex));
+  QS_UNWRAP(pthread_cond_signal(&job_available));
+}
+
+void worker::wait_done() {
+  QS_UNWRAP(pthread_mutex_lock(&mutex));
+  while (pending.load(std::memory_order_acquire) > 0) {
+    QS_UNWRAP(pthread_cond_wait(&drained, &mutex));
+  }
+  QS_UNWRAP(pthread_mutex_unlock(&mutex));
+}
+
 void *scheduler::start_worker(qs::worker *w) {
   w->start();
   return nullptr;
 }
 
-scheduler::scheduler(std::size_t threads_count)
-    : thread_pool{threads_count}, workers{threads_count * 2} {
+scheduler::scheduler(std::size_t threads_count, std::size_t spin_budget)
+    : thread_pool{threads_count + 1}, workers{new worker[threads_count]},
+      workers_count{threads_count} {
+  for (std::size_t i{0}; i < threads_count; ++i) {
+    workers[i].spin_budget = spin_budget;
+  }
   for (std::size_t i{0}; i < threads_count; ++i) {
     pthread_t thread_id;
-    workers.push(qs::worker{});
     QS_UNWRAP(pthread_create(
         &thread_id, nullptr,
         reinterpret_cast<void *(*)(void *)>(this->start_worker), &workers[i]));
@@ -22,9 +89,19 @@ scheduler::scheduler(std::size_t threads_count)
   }
 }
 
+scheduler::~scheduler() {
+  for (std::size_t i{0}; i < workers_count; ++i) {
+    workers[i].stop();
+  }
+  for (auto &thread_id : thread_pool) {
+    pthread_join(thread_id, nullptr);
+  }
+  delete[] workers;
+}
+
 void scheduler::wait_all_finish() {
-  for (auto &worker : workers) {
-    worker.wait_done();
+  for (std::size_t i{0}; i < workers_count; ++i) {
+    workers[i].wait_done();
   }
 }
 
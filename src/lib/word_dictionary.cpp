@@ -0,0 +1,37 @@
+#include <qs/word_dictionary.hpp>
+
+#include <stdexcept>
+
+namespace qs {
+
+word_dictionary::~word_dictionary() {
+  for (auto chunk : chunks) {
+    delete[] chunk;
+  }
+}
+
+u32 word_dictionary::intern(string_view word) {
+  auto found = ids.lookup(word);
+  if (found != ids.end()) {
+    return *found;
+  }
+  u32 chunk = count >> QS_DICTIONARY_CHUNK_BITS;
+  if (chunk >= QS_DICTIONARY_MAX_CHUNKS) {
+    throw std::runtime_error("the word dictionary is full");
+  }
+  if (chunks[chunk] == nullptr) {
+    chunks[chunk] = new packed_word[QS_DICTIONARY_CHUNK_SIZE];
+  }
+  u32 id = count++;
+  auto &slot = chunks[chunk][id & (QS_DICTIONARY_CHUNK_SIZE - 1)];
+  slot = packed_word{word};
+  ids.insert(slot.get_string_view(), id);
+  return id;
+}
+
+u32 word_dictionary::find(string_view word) {
+  auto found = ids.lookup(word);
+  return found != ids.end() ? *found : npos;
+}
+
+} // namespace qs
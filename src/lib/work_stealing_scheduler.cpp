@@ -0,0 +1,221 @@
+#include <qs/error.h>
+#include <qs/work_stealing_scheduler.hpp>
+
+#include <sched.h>
+#include <stdexcept>
+
+namespace qs {
+
+thread_local work_stealing_scheduler::worker_state
+    *work_stealing_scheduler::current_worker = nullptr;
+
+void *work_stealing_scheduler::start_worker(worker_state *w) {
+  current_worker = w;
+  w->sched->run(w);
+  return nullptr;
+}
+
+work_stealing_scheduler::work_stealing_scheduler(std::size_t threads_count,
+                                                 std::size_t spin_budget)
+    : thread_pool{threads_count + 1}, workers{new worker_state[threads_count]},
+      workers_count{threads_count}, spin_budget{spin_budget} {
+  for (std::size_t i{0}; i < threads_count; ++i) {
+    workers[i].sched = this;
+    workers[i].index = i;
+    workers[i].rng = 0x9e3779b97f4a7c15ull * (i + 1);
+  }
+  for (std::size_t i{0}; i < threads_count; ++i) {
+    pthread_t thread_id;
+    QS_UNWRAP(pthread_create(
+        &thread_id, nullptr,
+        reinterpret_cast<void *(*)(void *)>(this->start_worker), &workers[i]));
+    thread_pool.push(thread_id);
+  }
+}
+
+work_stealing_scheduler::~work_stealing_scheduler() {
+  pthread_mutex_lock(&sleep_mutex);
+  stopping.store(true);
+  pthread_cond_broadcast(&work_available);
+  pthread_mutex_unlock(&sleep_mutex);
+  for (auto &thread_id : thread_pool) {
+    pthread_join(thread_id, nullptr);
+  }
+  delete[] workers;
+  pthread_mutex_destroy(&overflow_mutex);
+  pthread_mutex_destroy(&sleep_mutex);
+  pthread_cond_destroy(&work_available);
+  pthread_cond_destroy(&all_done);
+}
+
+void work_stealing_scheduler::wake_worker() {
+  if (sleepers.load() > 0) {
+    QS_UNWRAP(pthread_mutex_lock(&sleep_mutex));
+    QS_UNWRAP(pthread_cond_signal(&work_available));
+    QS_UNWRAP(pthread_mutex_unlock(&sleep_mutex));
+  }
+}
+
+void work_stealing_scheduler::submit_job(job *j) {
+  unfinished.fetch_add(1);
+  queued.fetch_add(1);
+  auto w = current_worker;
+  if (w != nullptr && w->sched == this) {
+    w->deque.push(j);
+  } else {
+    injector_size.fetch_add(1);
+    if (!injector.try_enqueue(j)) {
+      QS_UNWRAP(pthread_mutex_lock(&overflow_mutex));
+      overflow.enqueue(j);
+      overflow_size.fetch_add(1);
+      QS_UNWRAP(pthread_mutex_unlock(&overflow_mutex));
+    }
+  }
+  wake_worker();
+}
+
+job *work_stealing_scheduler::steal_job(worker_state *w) {
+  if (workers_count < 2) {
+    return nullptr;
+  }
+  // xorshift to pick where to start looking so thieves spread out
+  w->rng ^= w->rng << 13;
+  w->rng ^= w->rng >> 7;
+  w->rng ^= w->rng << 17;
+  std::size_t start = w->rng % workers_count;
+  for (std::size_t i = 0; i < workers_count; i++) {
+    auto &victim = workers[(start + i) % workers_count];
+    if (&victim == w) {
+      continue;
+    }
+    job *j;
+    if (victim.deque.steal(j)) {
+      w->steals.fetch_add(1, std::memory_order_relaxed);
+      return j;
+    }
+  }
+  w->failed_steals.fetch_add(1, std::memory_order_relaxed);
+  return nullptr;
+}
+
+job *work_stealing_scheduler::find_job(worker_state *w) {
+  job *j;
+  if (w->deque.pop(j)) {
+    return j;
+  }
+  if (injector_size.load() > 0) {
+    // The overflow goes first so the jobs that did not fit in the ring are
+    // not starved by newer ones
+    if (overflow_size.load() > 0) {
+      QS_UNWRAP(pthread_mutex_lock(&overflow_mutex));
+      auto injected = overflow.dequeue();
+      if (!injected.is_empty()) {
+        overflow_size.fetch_sub(1);
+      }
+      QS_UNWRAP(pthread_mutex_unlock(&overflow_mutex));
+      if (!injected.is_empty()) {
+        injector_size.fetch_sub(1);
+        return injected.get();
+      }
+    }
+    if (injector.try_dequeue(j)) {
+      injector_size.fetch_sub(1);
+      return j;
+    }
+  }
+  return steal_job(w);
+}
+
+void work_stealing_scheduler::execute(worker_state *w, job *j) {
+  queued.fetch_sub(1);
+  auto group = j->group;
+  (*j)();
+  delete j;
+  w->executed.fetch_add(1, std::memory_order_relaxed);
+  if (group != nullptr) {
+    group->pending.fetch_sub(1, std::memory_order_release);
+  }
+  if (unfinished.fetch_sub(1) == 1) {
+    QS_UNWRAP(pthread_mutex_lock(&sleep_mutex));
+    QS_UNWRAP(pthread_cond_broadcast(&all_done));
+    QS_UNWRAP(pthread_mutex_unlock(&sleep_mutex));
+  }
+}
+
+// Runs one queued job on the calling worker. Returns false if the caller is
+// not a worker of this scheduler or there was nothing to run
+bool work_stealing_scheduler::run_pending_job() {
+  auto w = current_worker;
+  if (w == nullptr || w->sched != this) {
+    return false;
+  }
+  job *j = find_job(w);
+  if (j == nullptr) {
+    return false;
+  }
+  execute(w, j);
+  return true;
+}
+
+void work_stealing_scheduler::run(worker_state *w) {
+  while (true) {
+    job *j = find_job(w);
+    // Poll the cheap queued counter for a while before parking and only go
+    // looking for the job once one shows up
+    for (std::size_t spins = 0; j == nullptr && spins < spin_budget; spins++) {
+      QS_CPU_RELAX();
+      if (queued.load(std::memory_order_relaxed) > 0) {
+        j = find_job(w);
+      }
+    }
+    if (j != nullptr) {
+      execute(w, j);
+      continue;
+    }
+
+    QS_UNWRAP(pthread_mutex_lock(&sleep_mutex));
+    sleepers.fetch_add(1);
+    while (queued.load() <= 0 && !stopping.load()) {
+      QS_UNWRAP(pthread_cond_wait(&work_available, &sleep_mutex));
+    }
+    sleepers.fetch_sub(1);
+    bool done = stopping.load() && queued.load() <= 0;
+    QS_UNWRAP(pthread_mutex_unlock(&sleep_mutex));
+    if (done) {
+      break;
+    }
+  }
+}
+
+void work_stealing_scheduler::wait_all_finish() {
+  QS_UNWRAP(pthread_mutex_lock(&sleep_mutex));
+  while (unfinished.load() > 0) {
+    QS_UNWRAP(pthread_cond_wait(&all_done, &sleep_mutex));
+  }
+  QS_UNWRAP(pthread_mutex_unlock(&sleep_mutex));
+}
+
+void task_group::spawn(job *j) {
+  j->group = this;
+  pending.fetch_add(1, std::memory_order_relaxed);
+  sched.submit_job(j);
+}
+
+void task_group::wait() {
+  while (pending.load(std::memory_order_acquire) > 0) {
+    if (!sched.run_pending_job()) {
+      sched_yield();
+    }
+  }
+}
+
+scheduler_stats work_stealing_scheduler::get_stats(std::size_t worker) const {
+  if (worker >= workers_count) {
+    throw std::runtime_error("index out of bounds");
+  }
+  auto &w = workers[worker];
+  return scheduler_stats{w.executed.load(), w.steals.load(),
+                         w.failed_steals.load(), w.deque.size()};
+}
+
+} // namespace qs
@@ -0,0 +1,90 @@
+#include "catch_amalgamated.hpp"
+
+#include <qs/arena.hpp>
+#include <qs/hash_set.hpp>
+#include <qs/hash_table.hpp>
+#include <qs/memory.hpp>
+#include <qs/string_view.h>
+#include <qs/vector.hpp>
+
+#include <cstdint>
+
+TEST_CASE("the arena works as expected", "[arena]") {
+  qs::arena a{1024};
+
+  SECTION("allocations are aligned and do not overlap") {
+    auto c = a.allocate<char>(3);
+    auto d = a.allocate<double>(2);
+    auto w = a.allocate(64, 32);
+    REQUIRE(reinterpret_cast<std::uintptr_t>(d) % alignof(double) == 0);
+    REQUIRE(reinterpret_cast<std::uintptr_t>(w) % 32 == 0);
+    REQUIRE(reinterpret_cast<char *>(d) >= c + 3);
+    REQUIRE(static_cast<char *>(w) >= reinterpret_cast<char *>(d + 2));
+  }
+
+  SECTION("allocations bigger than a block get their own block") {
+    auto big = a.allocate<char>(4096);
+    big[4095] = 'x';
+    REQUIRE(a.get_capacity() >= 4096);
+  }
+
+  SECTION("reset reuses the blocks") {
+    for (int i = 0; i < 100; i++) {
+      a.allocate<int>(100);
+    }
+    auto capacity = a.get_capacity();
+    auto first = a.allocate<int>();
+    a.reset();
+    for (int i = 0; i < 100; i++) {
+      a.allocate<int>(100);
+    }
+    REQUIRE(a.get_capacity() == capacity);
+    a.reset();
+    REQUIRE(a.allocate<int>() != nullptr);
+    REQUIRE(first != nullptr);
+  }
+
+  SECTION("make constructs objects in place") {
+    auto p = a.make<qs::vector<int>>(4, &a);
+    p->push(1);
+    REQUIRE(p->at(0) == 1);
+    p->~vector();
+  }
+}
+
+TEST_CASE("containers allocate from an arena", "[arena]") {
+  qs::arena a{};
+
+  SECTION("a vector keeps growing in the arena") {
+    qs::vector<qs::unique_pointer<int>> v{2, &a};
+    for (int i = 0; i < 1000; i++) {
+      v.push(qs::make_unique<int>(i));
+    }
+    for (int i = 0; i < 1000; i++) {
+      REQUIRE(*v.at(i) == i);
+    }
+    auto moved = std::move(v);
+    moved.push(qs::make_unique<int>(1000));
+    REQUIRE(moved.get_size() == 1001);
+  }
+
+  SECTION("a hash table resizes in the arena") {
+    qs::hash_table<int, int> ht{4, &a};
+    for (int i = 0; i < 1000; i++) {
+      ht.insert(i, i * 2);
+    }
+    REQUIRE(ht.get_size() == 1000);
+    for (int i = 0; i < 1000; i++) {
+      REQUIRE(*ht.lookup(i) == i * 2);
+    }
+  }
+
+  SECTION("a hash set in the arena") {
+    qs::hash_set<qs::string_view> hs{4, &a};
+    hs.insert(qs::string_view{"hello"});
+    hs.insert(qs::string_view{"world"});
+    hs.insert(qs::string_view{"hello"});
+    REQUIRE(hs.get_size() == 2);
+    REQUIRE(hs.contains(qs::string_view{"world"}));
+  }
+}
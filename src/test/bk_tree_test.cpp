@@ -181,6 +181,22 @@ SCENARIO("BK-Tree correct construction and matching", "[bk_tree]") {
       }
     }
 
+    WHEN("Looking up words near 'poor' with every threshold at once") {
+      auto matches = tree.match_multi(3, qs::string_view("poor"));
+      THEN("each match has its distance and agrees with match") {
+        for (int threshold = 0; threshold <= 3; threshold++) {
+          std::size_t within = 0;
+          for (auto &m : matches) {
+            REQUIRE(m.distance ==
+                    qs::edit_distance(*m.data, qs::string_view("poor")));
+            within += m.distance <= threshold;
+          }
+          REQUIRE(within ==
+                  tree.match(threshold, qs::string_view("poor")).get_size());
+        }
+      }
+    }
+
     WHEN("Looking up words near 'helped' with threshold 0") {
       THEN("'helped' is found") {
         auto words = tree.match(0, qs::string_view("helped"));
@@ -203,3 +219,55 @@ SCENARIO("BK-Tree correct construction and matching", "[bk_tree]") {
     }
   }
 }
+
+SCENARIO("BK-Tree removal and compaction", "[bk_tree]") {
+  GIVEN("A BK-Tree using edit distance") {
+    const char *words[] = {"help",  "hell",  "hello",  "loop",  "helps",
+                           "shell", "helper", "troop", "helped", "cult"};
+    auto tree = qs::bk_tree<qs::string_view>(&qs::edit_distance);
+    for (auto w : words) {
+      tree.insert(qs::string_view(w));
+    }
+
+    WHEN("a word is removed") {
+      REQUIRE(tree.remove(qs::string_view("hello")));
+      THEN("it is not found or matched but its node stays") {
+        REQUIRE(tree.find(qs::string_view("hello")) == nullptr);
+        REQUIRE(tree.match(0, qs::string_view("hello")).get_size() == 0);
+        REQUIRE(tree.match(2, qs::string_view("shell")).get_size() == 3);
+        REQUIRE(tree.get_size() == 10);
+        REQUIRE(tree.get_dead_count() == 1);
+        REQUIRE_FALSE(tree.remove(qs::string_view("hello")));
+      }
+
+      THEN("inserting it again takes the node back") {
+        tree.insert(qs::string_view("hello"));
+        REQUIRE(tree.find(qs::string_view("hello")) != nullptr);
+        REQUIRE(tree.get_size() == 10);
+        REQUIRE(tree.get_dead_count() == 0);
+      }
+
+      THEN("compacting drops the node and keeps the other words") {
+        tree.compact();
+        REQUIRE(tree.get_size() == 9);
+        REQUIRE(tree.get_dead_count() == 0);
+        for (auto w : words) {
+          auto found = tree.find(qs::string_view(w));
+          REQUIRE((found == nullptr) == (qs::string_view(w) == "hello"));
+        }
+        REQUIRE(tree.match(3, qs::string_view("poor")).get_size() == 2);
+      }
+    }
+
+    WHEN("every word is removed and the tree is compacted") {
+      for (auto w : words) {
+        REQUIRE(tree.remove(qs::string_view(w)));
+      }
+      tree.compact();
+      THEN("the tree is empty") {
+        REQUIRE(tree.get_size() == 0);
+        REQUIRE(tree.match(3, qs::string_view("help")).get_size() == 0);
+      }
+    }
+  }
+}
@@ -0,0 +1,115 @@
+#include "catch_amalgamated.hpp"
+
+#include <qs/bk_tree.hpp>
+#include <qs/deletion_index.hpp>
+#include <qs/distances.hpp>
+#include <qs/hash_set.hpp>
+#include <qs/string_view.h>
+
+#include <string>
+#include <vector>
+
+static const char *deletion_words[] = {
+    "help", "hell", "hello", "loop", "helps", "shell", "helper", "cult", "troop",
+    "helped", "felt", "fell", "smal", "melt", "fall", "poor", "pool", "tool"};
+
+static qs::hash_set<qs::string_view>
+deletion_set(qs::linked_list<qs::string_view *> words) {
+  qs::hash_set<qs::string_view> ret{64};
+  for (auto w : words) {
+    ret.insert(*w);
+  }
+  return ret;
+}
+
+static qs::string_view same_view(const qs::string_view &d) { return d; }
+
+SCENARIO("Deletion index matches like the BK-Tree it was built from",
+         "[deletion_index]") {
+  GIVEN("A BK-Tree using edit distance") {
+    auto tree = qs::bk_tree<qs::string_view>(&qs::edit_distance);
+    for (auto w : deletion_words) {
+      tree.insert(qs::string_view(w));
+    }
+    qs::deletion_index<qs::string_view> index{};
+    REQUIRE(index.rebuild(tree, 3, 1 << 20, &same_view));
+    REQUIRE(index.get_size() == tree.get_size());
+    REQUIRE(index.get_max_dist() == 3);
+    REQUIRE(index.get_memory() > 0);
+
+    THEN("every query returns the same words for every threshold") {
+      for (auto w : deletion_words) {
+        for (int threshold = 0; threshold <= 3; threshold++) {
+          auto q = qs::string_view(w);
+          auto expected = deletion_set(tree.match(threshold, q));
+          auto got = deletion_set(index.match(threshold, q));
+          REQUIRE(got.get_size() == expected.get_size());
+          for (auto &e : expected) {
+            REQUIRE(got.contains(e));
+          }
+        }
+      }
+    }
+
+    THEN("the distances are the edit distances") {
+      auto q = qs::string_view("helpe");
+      index.traverse(3, q, [&q](qs::string_view *w, int d) {
+        REQUIRE(d == qs::edit_distance(*w, q));
+      });
+    }
+
+    WHEN("it is built for a smaller distance") {
+      REQUIRE(index.rebuild(tree, 1, 1 << 20, &same_view));
+      THEN("bigger thresholds still find every word") {
+        for (auto w : deletion_words) {
+          auto q = qs::string_view(w);
+          REQUIRE(deletion_set(index.match(3, q)).get_size() ==
+                  deletion_set(tree.match(3, q)).get_size());
+        }
+      }
+    }
+
+    WHEN("the variants do not fit in the size cap") {
+      THEN("the build fails and the index is empty") {
+        REQUIRE_FALSE(index.rebuild(tree, 3, 256, &same_view));
+        REQUIRE(index.get_size() == 0);
+        REQUIRE(index.match(0, qs::string_view("hell")).get_size() == 0);
+      }
+    }
+  }
+
+  GIVEN("Random words over a small alphabet") {
+    std::vector<std::string> words;
+    u64 state = 5;
+    auto next = [&state]() {
+      state = state * 6364136223846793005ull + 1442695040888963407ull;
+      return state >> 33;
+    };
+    for (int i = 0; i < 500; i++) {
+      std::string w(4 + next() % 10, 'a');
+      for (auto &c : w) {
+        c = (char)('a' + next() % 4);
+      }
+      words.push_back(w);
+    }
+    auto tree = qs::bk_tree<qs::string_view>(&qs::edit_distance);
+    for (auto &w : words) {
+      auto view = qs::string_view(w.c_str());
+      if (tree.find(view) == nullptr) {
+        tree.insert(view);
+      }
+    }
+    qs::deletion_index<qs::string_view> index{};
+    REQUIRE(index.rebuild(tree, 3, 64 << 20, &same_view));
+
+    THEN("the index finds what the tree finds") {
+      for (int i = 0; i < 50; i++) {
+        auto q = qs::string_view(words[i].c_str());
+        for (int threshold = 0; threshold <= 3; threshold++) {
+          REQUIRE(deletion_set(index.match(threshold, q)).get_size() ==
+                  deletion_set(tree.match(threshold, q)).get_size());
+        }
+      }
+    }
+  }
+}
@@ -17,6 +17,49 @@ TEST_CASE("Hamming distance", "[distances]") {
   }
 }
 
+TEST_CASE("Packed hamming distance", "[distances]") {
+  const char *words[] = {"hell", "felt", "help", "fell", "suasa", "alana",
+                         "abcdefghijklmnopqrstuvwxyzabcde",
+                         "abcdefghijklmnopqrstuvwxyzabcdf",
+                         "zbcdefghijklmnopqrstuvwxyzabcde"};
+  SECTION("agrees with the byte by byte implementation") {
+    for (auto w1 : words) {
+      for (auto w2 : words) {
+        auto s1 = qs::string_view(w1);
+        auto s2 = qs::string_view(w2);
+        if (s1.size() != s2.size()) {
+          continue;
+        }
+        auto p1 = qs::packed_word(s1);
+        auto p2 = qs::packed_word(s2);
+        int expected = qs::hamming_distance(s1, s2);
+        REQUIRE(qs::packed_hamming_distance(p1, p2) == expected);
+        REQUIRE(qs::packed_hamming_distance(p1.get_string_view(),
+                                            p2.get_string_view()) == expected);
+      }
+    }
+  }
+
+  SECTION("batch variant scores every word") {
+    qs::packed_word packed[4] = {
+        qs::packed_word(qs::string_view("hell")),
+        qs::packed_word(qs::string_view("felt")),
+        qs::packed_word(qs::string_view("help")),
+        qs::packed_word(qs::string_view("fell"))};
+    int out[4];
+    qs::packed_hamming_distance_batch(packed[0], packed, 4, out);
+    REQUIRE(out[0] == 0);
+    REQUIRE(out[1] == 2);
+    REQUIRE(out[2] == 1);
+    REQUIRE(out[3] == 1);
+  }
+
+  SECTION("words that do not fit in a slot are rejected") {
+    REQUIRE_THROWS(qs::packed_word(
+        qs::string_view("abcdefghijklmnopqrstuvwxyzabcdef")));
+  }
+}
+
 TEST_CASE("Edit distance", "[distances]") {
   SECTION("'hell' and 'felt'") {
     REQUIRE(qs::edit_distance(qs::string_view("hell"),
@@ -48,3 +91,51 @@ TEST_CASE("Edit distance", "[distances]") {
                               qs::string_view("mahemn")) == 2);
   }
 }
+
+TEST_CASE("Bit parallel edit distance", "[distances]") {
+  const char *words[] = {"hell",
+                         "felt",
+                         "help",
+                         "troop",
+                         "ahem",
+                         "mahemn",
+                         "abc",
+                         "bc",
+                         "ac",
+                         "pope",
+                         "clement",
+                         "clementine",
+                         "synagogue",
+                         "rabbi",
+                         "rebbe",
+                         "diocese",
+                         "dioceses",
+                         "gaither",
+                         "anderson",
+                         "abcdefghijklmnopqrstuvwxyzabcde",
+                         "bcdefghijklmnopqrstuvwxyzabcdea"};
+  SECTION("agrees with the dynamic programming implementation") {
+    for (auto w1 : words) {
+      for (auto w2 : words) {
+        auto s1 = qs::string_view(w1);
+        auto s2 = qs::string_view(w2);
+        REQUIRE(qs::bit_parallel_edit_distance(s1, s2) ==
+                qs::edit_distance(s1, s2));
+      }
+    }
+  }
+
+  SECTION("bounded variant saturates at max_dist + 1") {
+    for (auto w1 : words) {
+      for (auto w2 : words) {
+        auto s1 = qs::string_view(w1);
+        auto s2 = qs::string_view(w2);
+        int d = qs::edit_distance(s1, s2);
+        for (int max_dist = 0; max_dist <= 3; max_dist++) {
+          int expected = d <= max_dist ? d : max_dist + 1;
+          REQUIRE(qs::bounded_edit_distance(s1, s2, max_dist) == expected);
+        }
+      }
+    }
+  }
+}
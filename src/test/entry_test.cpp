@@ -12,4 +12,13 @@ TEST_CASE("Entry single-argument constructor works", "[entry]") {
       REQUIRE(en.get_string_view() == input);
     }
   }
-}
\ No newline at end of file
+}
+TEST_CASE("Word entries point to the dictionary slot", "[entry]") {
+  auto word = qs::packed_word{qs::string_view("teststring")};
+  auto en = qs::word_entry<int>(7, &word, 42);
+
+  REQUIRE(en.id == 7);
+  REQUIRE(en.payload == 42);
+  REQUIRE(en.get_string_view() == qs::string_view("teststring"));
+  REQUIRE(en.get_string_view().begin() == word.data);
+}
@@ -0,0 +1,105 @@
+#include "catch_amalgamated.hpp"
+
+#include <qs/bk_tree.hpp>
+#include <qs/distances.hpp>
+#include <qs/flat_bk_tree.hpp>
+#include <qs/hash_set.hpp>
+#include <qs/string_view.h>
+
+static const char *flat_tree_words[] = {
+    "help", "hell", "hello", "loop", "helps", "shell", "helper", "cult", "troop",
+    "helped", "felt", "fell", "smal", "melt", "fall", "poor", "pool", "tool"};
+
+static qs::hash_set<qs::string_view>
+to_set(qs::linked_list<qs::string_view *> words) {
+  qs::hash_set<qs::string_view> ret{64};
+  for (auto w : words) {
+    ret.insert(*w);
+  }
+  return ret;
+}
+
+SCENARIO("Flat BK-Tree matches like the BK-Tree it was built from",
+         "[flat_bk_tree]") {
+  GIVEN("A BK-Tree using edit distance") {
+    auto tree = qs::bk_tree<qs::string_view>(&qs::edit_distance);
+    for (auto w : flat_tree_words) {
+      tree.insert(qs::string_view(w));
+    }
+    auto flat = qs::flat_bk_tree<qs::string_view>(tree);
+    REQUIRE(flat.get_size() == tree.get_size());
+
+    THEN("every query returns the same words for every threshold") {
+      for (auto w : flat_tree_words) {
+        for (int threshold = 0; threshold <= 3; threshold++) {
+          auto q = qs::string_view(w);
+          auto expected = to_set(tree.match(threshold, q));
+          auto got = to_set(flat.match(threshold, q));
+          REQUIRE(got.get_size() == expected.get_size());
+          for (auto &e : expected) {
+            REQUIRE(got.contains(e));
+          }
+        }
+      }
+    }
+
+    THEN("one multi threshold search returns the matches of every threshold") {
+      for (auto w : flat_tree_words) {
+        auto q = qs::string_view(w);
+        auto matches = flat.match_multi(3, q);
+        REQUIRE(matches.get_size() == tree.match_multi(3, q).get_size());
+        for (int threshold = 0; threshold <= 3; threshold++) {
+          auto expected = to_set(tree.match(threshold, q));
+          std::size_t within = 0;
+          for (auto &m : matches) {
+            if (m.distance <= threshold) {
+              within++;
+              REQUIRE(expected.contains(*m.data));
+            }
+          }
+          REQUIRE(within == expected.get_size());
+        }
+      }
+    }
+
+    THEN("iterating visits the data of every node once") {
+      auto seen = qs::hash_set<qs::string_view>{64};
+      for (auto &w : flat) {
+        seen.insert(w);
+      }
+      REQUIRE(seen.get_size() == tree.get_size());
+      REQUIRE(flat.end() - flat.begin() == (long)tree.get_size());
+      REQUIRE(flat.get_distance_function() == &qs::edit_distance);
+    }
+
+    WHEN("words are removed from the source tree") {
+      tree.remove(qs::string_view("hell"));
+      flat.rebuild(tree);
+      THEN("the flat tree skips them but still finds their subtrees") {
+        REQUIRE(flat.match(0, qs::string_view("hell")).get_size() == 0);
+        for (auto w : flat_tree_words) {
+          auto q = qs::string_view(w);
+          REQUIRE(to_set(flat.match(2, q)).get_size() ==
+                  to_set(tree.match(2, q)).get_size());
+        }
+      }
+    }
+
+    WHEN("words are inserted after the flat tree is built") {
+      tree.insert(qs::string_view("helm"));
+      THEN("they are only visible after a rebuild") {
+        REQUIRE(flat.match(0, qs::string_view("helm")).get_size() == 0);
+        flat.rebuild(tree);
+        REQUIRE(flat.match(0, qs::string_view("helm")).get_size() == 1);
+      }
+    }
+  }
+
+  GIVEN("An empty BK-Tree") {
+    auto tree = qs::bk_tree<qs::string_view>(&qs::edit_distance);
+    auto flat = qs::flat_bk_tree<qs::string_view>(tree);
+    THEN("Matching returns nothing") {
+      REQUIRE(flat.match(3, qs::string_view("str")).get_size() == 0);
+    }
+  }
+}
@@ -0,0 +1,95 @@
+#include "catch_amalgamated.hpp"
+
+#include <qs/bk_tree.hpp>
+#include <qs/distances.hpp>
+#include <qs/flat_scan.hpp>
+#include <qs/hash_set.hpp>
+#include <qs/string_view.h>
+
+#include <string>
+#include <vector>
+
+static qs::hash_set<qs::string_view>
+scan_set(qs::linked_list<qs::string_view *> words) {
+  qs::hash_set<qs::string_view> ret{64};
+  for (auto w : words) {
+    ret.insert(*w);
+  }
+  return ret;
+}
+
+// Random words over a small alphabet so that many of them are close
+static std::vector<std::string> scan_words(std::size_t n, bool same_length) {
+  std::vector<std::string> words;
+  u64 state = 17;
+  auto next = [&state]() {
+    state = state * 6364136223846793005ull + 1442695040888963407ull;
+    return state >> 33;
+  };
+  for (std::size_t i = 0; i < n; i++) {
+    std::string w(same_length ? 7 : 3 + next() % 10, 'a');
+    for (auto &c : w) {
+      c = (char)('a' + next() % 4);
+    }
+    words.push_back(w);
+  }
+  return words;
+}
+
+static void require_same_matches(qs::distance_function dist,
+                                 std::vector<std::string> &words) {
+  auto tree = qs::bk_tree<qs::string_view>(dist);
+  for (auto &w : words) {
+    auto view = qs::string_view(w.c_str());
+    if (tree.find(view) == nullptr) {
+      tree.insert(view);
+    }
+  }
+  // Removed words are not copied, the tree still counts them until it is
+  // compacted
+  tree.remove(qs::string_view(words[0].c_str()));
+  qs::flat_scan<qs::string_view> scan{tree};
+  REQUIRE(scan.get_size() + 1 == tree.get_size());
+  REQUIRE(scan.get_distance_function() == dist);
+
+  for (std::size_t i = 0; i < 40; i++) {
+    auto q = qs::string_view(words[i].c_str());
+    for (int threshold = 0; threshold <= 3; threshold++) {
+      auto expected = scan_set(tree.match(threshold, q));
+      auto got = scan_set(scan.match(threshold, q));
+      REQUIRE(got.get_size() == expected.get_size());
+      for (auto &e : expected) {
+        REQUIRE(got.contains(e));
+      }
+      scan.traverse(threshold, q, [&](qs::string_view *w, int d) {
+        REQUIRE(d == (*dist)(*w, q));
+      });
+    }
+  }
+}
+
+SCENARIO("Flat scan matches like the BK-Tree it was built from",
+         "[flat_scan]") {
+  GIVEN("Words of one length using hamming distance") {
+    auto words = scan_words(300, true);
+    THEN("the batch kernel finds what the tree finds") {
+      require_same_matches(&qs::hamming_distance, words);
+    }
+  }
+
+  GIVEN("Words of many lengths using edit distance") {
+    auto words = scan_words(300, false);
+    THEN("the filtered scan finds what the tree finds") {
+      require_same_matches(&qs::edit_distance, words);
+    }
+  }
+
+  GIVEN("An empty tree") {
+    auto tree = qs::bk_tree<qs::string_view>(&qs::edit_distance);
+    qs::flat_scan<qs::string_view> scan{tree};
+    THEN("nothing is found") {
+      REQUIRE(scan.get_size() == 0);
+      REQUIRE(scan.match(3, qs::string_view("word")).get_size() == 0);
+    }
+  }
+}
@@ -0,0 +1,110 @@
+#include "catch_amalgamated.hpp"
+
+#include <qs/bk_tree.hpp>
+#include <qs/distances.hpp>
+#include <qs/flat_trie.hpp>
+#include <qs/hash_set.hpp>
+#include <qs/string_view.h>
+
+#include <string>
+#include <vector>
+
+static const char *trie_words[] = {
+    "help", "hell", "hello", "loop", "helps", "shell", "helper", "cult", "troop",
+    "helped", "felt", "fell", "smal", "melt", "fall", "poor", "pool", "tool"};
+
+static qs::hash_set<qs::string_view>
+trie_set(qs::linked_list<qs::string_view *> words) {
+  qs::hash_set<qs::string_view> ret{64};
+  for (auto w : words) {
+    ret.insert(*w);
+  }
+  return ret;
+}
+
+SCENARIO("Flat trie matches like the BK-Tree it was built from",
+         "[flat_trie]") {
+  GIVEN("A BK-Tree using edit distance") {
+    auto tree = qs::bk_tree<qs::string_view>(&qs::edit_distance);
+    for (auto w : trie_words) {
+      tree.insert(qs::string_view(w));
+    }
+    auto trie = qs::flat_trie<qs::string_view>(tree);
+    REQUIRE(trie.get_size() == tree.get_size());
+    REQUIRE(trie.get_distance_function() == &qs::edit_distance);
+
+    THEN("every query returns the same words for every threshold") {
+      for (auto w : trie_words) {
+        for (int threshold = 0; threshold <= 3; threshold++) {
+          auto q = qs::string_view(w);
+          auto expected = trie_set(tree.match(threshold, q));
+          auto got = trie_set(trie.match(threshold, q));
+          REQUIRE(got.get_size() == expected.get_size());
+          for (auto &e : expected) {
+            REQUIRE(got.contains(e));
+          }
+        }
+      }
+    }
+
+    THEN("the distances are the edit distances") {
+      auto q = qs::string_view("helpe");
+      trie.traverse(3, q, [&q](qs::string_view *w, int d) {
+        REQUIRE(d == qs::edit_distance(*w, q));
+      });
+    }
+
+    WHEN("words are removed from the source tree") {
+      tree.remove(qs::string_view("hell"));
+      trie.rebuild(tree);
+      THEN("the trie does not have them") {
+        REQUIRE(trie.get_size() == tree.get_size() - tree.get_dead_count());
+        REQUIRE(trie.match(0, qs::string_view("hell")).get_size() == 0);
+        REQUIRE(trie.match(0, qs::string_view("hello")).get_size() == 1);
+      }
+    }
+  }
+
+  GIVEN("Random words over a small alphabet") {
+    // Small alphabets give long shared prefixes and many close words
+    std::vector<std::string> words;
+    u64 state = 11;
+    auto next = [&state]() {
+      state = state * 6364136223846793005ull + 1442695040888963407ull;
+      return state >> 33;
+    };
+    for (int i = 0; i < 500; i++) {
+      std::string w(4 + next() % 10, 'a');
+      for (auto &c : w) {
+        c = (char)('a' + next() % 4);
+      }
+      words.push_back(w);
+    }
+    auto tree = qs::bk_tree<qs::string_view>(&qs::edit_distance);
+    for (auto &w : words) {
+      auto view = qs::string_view(w.c_str());
+      if (tree.find(view) == nullptr) {
+        tree.insert(view);
+      }
+    }
+    auto trie = qs::flat_trie<qs::string_view>(tree);
+
+    THEN("the trie finds what the tree finds") {
+      for (int i = 0; i < 50; i++) {
+        auto q = qs::string_view(words[i].c_str());
+        for (int threshold = 0; threshold <= 3; threshold++) {
+          REQUIRE(trie_set(trie.match(threshold, q)).get_size() ==
+                  trie_set(tree.match(threshold, q)).get_size());
+        }
+      }
+    }
+  }
+
+  GIVEN("An empty BK-Tree") {
+    auto tree = qs::bk_tree<qs::string_view>(&qs::edit_distance);
+    auto trie = qs::flat_trie<qs::string_view>(tree);
+    THEN("Matching returns nothing") {
+      REQUIRE(trie.match(3, qs::string_view("str")).get_size() == 0);
+    }
+  }
+}
@@ -40,6 +40,49 @@ TEST_CASE("open addressing hash table behaves as expected", "[hash_table]") {
     /* } */
   }
 
+  SECTION("removing keeps the keys that collided with the removed one") {
+    struct same_hash {
+      std::size_t operator()(int) const { return 7; }
+    };
+    qs::hash_table<int, int, same_hash> ht{16};
+    for (int i = 0; i < 10; ++i) {
+      ht.insert(i, i * 10);
+    }
+    ht.remove(0);
+    ht.remove(5);
+    REQUIRE(ht.get_size() == 8);
+    for (int i = 0; i < 10; ++i) {
+      if (i == 0 || i == 5) {
+        REQUIRE(ht.lookup(i) == ht.end());
+      } else {
+        REQUIRE(*ht.lookup(i) == i * 10);
+      }
+    }
+    ht.insert(5, 55);
+    REQUIRE(*ht.lookup(5) == 55);
+    REQUIRE(ht.get_size() == 9);
+  }
+
+  SECTION("removing from a table that wraps around") {
+    qs::hash_table<qs::string, int> ht{10};
+    constexpr int max = 40;
+    for (int i = 0; i < max; ++i) {
+      ht.insert(qs::string(i), i);
+    }
+    for (int i = 0; i < max; i += 2) {
+      ht.remove(qs::string(i));
+    }
+    REQUIRE(ht.get_size() == max / 2);
+    for (int i = 0; i < max; ++i) {
+      auto found = ht.lookup(qs::string(i));
+      if (i % 2 == 0) {
+        REQUIRE(found == ht.end());
+      } else {
+        REQUIRE(*found == i);
+      }
+    }
+  }
+
   SECTION("open addressing hash table of smart pointers") {
     qs::hash_table<qs::string, qs::unique_pointer<int>> ht;
     ht.insert(qs::string("1"), qs::make_unique<int>(1));
@@ -0,0 +1,124 @@
+#include "catch_amalgamated.hpp"
+
+#include <qs/metrics.hpp>
+
+#include <cstring>
+#include <string>
+#include <thread>
+#include <unistd.h>
+
+TEST_CASE("metrics are registered by name", "[metrics]") {
+  auto a = qs::metrics::register_counter("test.registry");
+  auto b = qs::metrics::register_counter("test.registry");
+  auto c = qs::metrics::register_counter("test.registry_other");
+  REQUIRE(a.id == b.id);
+  REQUIRE(a.id != c.id);
+}
+
+TEST_CASE("disabled metrics record nothing", "[metrics]") {
+  auto c = qs::metrics::register_counter("test.disabled");
+  auto h = qs::metrics::register_histogram("test.disabled_ns");
+  qs::metrics::set_enabled(false);
+  qs::metrics::add(c, 5);
+  qs::metrics::record(h, 5);
+  { qs::metrics::scoped_timer timer{h}; }
+  REQUIRE(qs::metrics::start() == 0);
+  REQUIRE(qs::metrics::get_counter(c) == 0);
+  REQUIRE(qs::metrics::get_histogram(h).count == 0);
+}
+
+// Built with -Dmetrics=false nothing is ever recorded
+#ifndef QS_METRICS_DISABLED
+TEST_CASE("counters add up the counts of every thread", "[metrics]") {
+  auto c = qs::metrics::register_counter("test.threads");
+  qs::metrics::set_enabled(true);
+  qs::metrics::reset();
+
+  std::thread threads[4];
+  for (auto &t : threads) {
+    t = std::thread([c]() {
+      for (int i = 0; i < 1000; i++) {
+        qs::metrics::add(c);
+      }
+    });
+  }
+  for (auto &t : threads) {
+    t.join();
+  }
+  qs::metrics::add(c, 10);
+  REQUIRE(qs::metrics::get_counter(c) == 4010);
+
+  qs::metrics::reset();
+  REQUIRE(qs::metrics::get_counter(c) == 0);
+  qs::metrics::set_enabled(false);
+}
+
+TEST_CASE("histograms report percentiles within their precision",
+          "[metrics]") {
+  auto h = qs::metrics::register_histogram("test.percentiles");
+  qs::metrics::set_enabled(true);
+  qs::metrics::reset();
+
+  SECTION("small values are exact") {
+    for (u64 v = 1; v <= 10; v++) {
+      qs::metrics::record(h, v);
+    }
+    auto s = qs::metrics::get_histogram(h);
+    REQUIRE(s.count == 10);
+    REQUIRE(s.sum == 55);
+    REQUIRE(s.p50 == 5);
+    REQUIRE(s.p90 == 9);
+    REQUIRE(s.max == 10);
+  }
+
+  SECTION("big values are at most 1/16th off") {
+    for (u64 v = 1; v <= 100000; v++) {
+      qs::metrics::record(h, v);
+    }
+    auto s = qs::metrics::get_histogram(h);
+    REQUIRE(s.count == 100000);
+    REQUIRE(s.sum == 5000050000ull);
+    REQUIRE(s.max == 100000);
+    REQUIRE(s.p50 >= 50000);
+    REQUIRE(s.p50 <= 50000 + 50000 / 16);
+    REQUIRE(s.p99 >= 99000);
+    REQUIRE(s.p99 <= 100000);
+  }
+
+  SECTION("values past the last bucket keep their max") {
+    qs::metrics::record(h, 1ull << 50);
+    auto s = qs::metrics::get_histogram(h);
+    REQUIRE(s.count == 1);
+    REQUIRE(s.max == 1ull << 50);
+    REQUIRE(s.p50 == 1ull << 50);
+  }
+
+  qs::metrics::set_enabled(false);
+}
+
+TEST_CASE("metrics are dumped as text", "[metrics]") {
+  auto c = qs::metrics::register_counter("test.dump");
+  auto h = qs::metrics::register_histogram("test.dump_ns");
+  qs::metrics::set_enabled(true);
+  qs::metrics::reset();
+  qs::metrics::add(c, 3);
+  qs::metrics::record(h, 7);
+
+  int fds[2];
+  REQUIRE(pipe(fds) == 0);
+  qs::metrics::dump(fds[1]);
+  close(fds[1]);
+  std::string out;
+  char buf[256];
+  ssize_t n;
+  while ((n = read(fds[0], buf, sizeof(buf))) > 0) {
+    out.append(buf, n);
+  }
+  close(fds[0]);
+
+  REQUIRE(out.find("counter test.dump 3\n") != std::string::npos);
+  REQUIRE(out.find("histogram test.dump_ns count=1 mean=7 p50=7 p90=7 "
+                   "p99=7 p999=7 max=7\n") != std::string::npos);
+  qs::metrics::set_enabled(false);
+}
+#endif
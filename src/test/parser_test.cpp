@@ -3,6 +3,9 @@
 #include <qs/parser.hpp>
 #include <qs/string.h>
 
+#include <string>
+#include <vector>
+
 TEST_CASE("Parse file line by line", "[parser]") {
   SECTION("SMALL TEST") {
     const char *filepath = "./src/test/resources/test_entry.txt";
@@ -51,3 +54,82 @@ TEST_CASE("Parse string token by token", "[parser]") {
     delete[] str;
   }
 }
+
+// The tokens of s the slow way, to check the vectorized scan against
+static std::vector<std::string> reference_tokens(const std::string &s,
+                                                 char del) {
+  std::vector<std::string> ret;
+  std::string token;
+  for (char c : s) {
+    if (c == del) {
+      if (!token.empty()) {
+        ret.push_back(token);
+      }
+      token.clear();
+    } else {
+      token += c;
+    }
+  }
+  if (!token.empty()) {
+    ret.push_back(token);
+  }
+  return ret;
+}
+
+static std::vector<std::string> parsed_tokens(const std::string &s, char del) {
+  std::vector<std::string> ret;
+  qs::parse_string(s.c_str(), del, [&](qs::string_view &entry) {
+    ret.emplace_back(entry.data(), entry.size());
+  });
+  return ret;
+}
+
+TEST_CASE("Parse string skips empty tokens", "[parser]") {
+  REQUIRE(parsed_tokens("", ' ').empty());
+  REQUIRE(parsed_tokens("   ", ' ').empty());
+  REQUIRE(parsed_tokens("First/", '/') == std::vector<std::string>{"First"});
+  REQUIRE(parsed_tokens("  a  b   c  ", ' ') ==
+          std::vector<std::string>{"a", "b", "c"});
+}
+
+TEST_CASE("Parse string across block boundaries", "[parser]") {
+  SECTION("Tokens that end on every offset of a block") {
+    for (std::size_t length = 1; length < 3 * QS_PARSER_BLOCK; length++) {
+      std::string s;
+      while (s.size() < 40 * QS_PARSER_BLOCK) {
+        s += std::string(length, 'a' + length % 26);
+        s += ' ';
+      }
+      REQUIRE(parsed_tokens(s, ' ') == reference_tokens(s, ' '));
+    }
+  }
+
+  SECTION("Random documents") {
+    u64 state = 7;
+    for (int doc = 0; doc < 200; doc++) {
+      std::string s;
+      state = state * 6364136223846793005ull + 1442695040888963407ull;
+      std::size_t length = (state >> 33) % (20 * QS_PARSER_BLOCK);
+      for (std::size_t i = 0; i < length; i++) {
+        state = state * 6364136223846793005ull + 1442695040888963407ull;
+        // Mostly letters with runs of spaces and some bytes past 127
+        auto r = (state >> 33) % 32;
+        s += r < 6 ? ' ' : r == 6 ? '\xe9' : (char)('a' + r % 26);
+      }
+      REQUIRE(parsed_tokens(s, ' ') == reference_tokens(s, ' '));
+    }
+  }
+
+  SECTION("Only the given length is parsed") {
+    std::string s(5 * QS_PARSER_BLOCK, 'x');
+    s[QS_PARSER_BLOCK - 1] = ' ';
+    std::vector<std::string> tokens;
+    qs::parse_string(s.c_str(), 2 * QS_PARSER_BLOCK + 3, ' ',
+                     [&](qs::string_view &entry) {
+                       tokens.emplace_back(entry.data(), entry.size());
+                     });
+    REQUIRE(tokens == std::vector<std::string>{
+                          std::string(QS_PARSER_BLOCK - 1, 'x'),
+                          std::string(QS_PARSER_BLOCK + 3, 'x')});
+  }
+}
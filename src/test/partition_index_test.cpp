@@ -0,0 +1,116 @@
+#include "catch_amalgamated.hpp"
+
+#include <qs/bk_tree.hpp>
+#include <qs/distances.hpp>
+#include <qs/hash_set.hpp>
+#include <qs/partition_index.hpp>
+#include <qs/string_view.h>
+
+#include <string>
+#include <vector>
+
+static const char *partition_words[] = {
+    "hello", "hells", "shell", "helps", "yells", "jello", "world", "worst",
+    "words", "swore", "cello", "bells", "fells", "hallo", "hullo", "help!"};
+
+static qs::hash_set<qs::string_view>
+partition_set(qs::linked_list<qs::string_view *> words) {
+  qs::hash_set<qs::string_view> ret{64};
+  for (auto w : words) {
+    ret.insert(*w);
+  }
+  return ret;
+}
+
+static qs::string_view same_view(const qs::string_view &d) { return d; }
+
+SCENARIO("Partition index matches like the BK-Tree it was built from",
+         "[partition_index]") {
+  GIVEN("A BK-Tree of words of one length using hamming distance") {
+    auto tree = qs::bk_tree<qs::string_view>(&qs::hamming_distance);
+    for (auto w : partition_words) {
+      tree.insert(qs::string_view(w));
+    }
+    qs::partition_index<qs::string_view> index{};
+    index.rebuild(tree, 3, &same_view);
+    REQUIRE(index.get_size() == tree.get_size());
+    REQUIRE(index.get_max_dist() == 3);
+
+    THEN("every query returns the same words for every threshold") {
+      for (auto w : partition_words) {
+        for (int threshold = 0; threshold <= 5; threshold++) {
+          auto q = qs::string_view(w);
+          auto expected = partition_set(tree.match(threshold, q));
+          auto got = partition_set(index.match(threshold, q));
+          REQUIRE(got.get_size() == expected.get_size());
+          for (auto &e : expected) {
+            REQUIRE(got.contains(e));
+          }
+        }
+      }
+    }
+
+    THEN("every match is reported once with its distance") {
+      auto q = qs::string_view("hello");
+      std::size_t count = 0;
+      index.traverse(3, q, [&q, &count](qs::string_view *w, int d) {
+        REQUIRE(d == qs::hamming_distance(*w, q));
+        count++;
+      });
+      REQUIRE(count == tree.match(3, q).get_size());
+    }
+
+    THEN("words of another length are never found") {
+      REQUIRE(index.match(3, qs::string_view("hell")).get_size() == 0);
+      REQUIRE(index.match(5, qs::string_view("helloo")).get_size() == 0);
+    }
+
+    WHEN("it is built for a smaller distance") {
+      index.rebuild(tree, 0, &same_view);
+      THEN("bigger thresholds still find every word") {
+        for (auto w : partition_words) {
+          auto q = qs::string_view(w);
+          REQUIRE(partition_set(index.match(2, q)).get_size() ==
+                  partition_set(tree.match(2, q)).get_size());
+        }
+      }
+    }
+  }
+
+  GIVEN("Random words over a small alphabet") {
+    std::vector<std::string> words;
+    u64 state = 11;
+    auto next = [&state]() {
+      state = state * 6364136223846793005ull + 1442695040888963407ull;
+      return state >> 33;
+    };
+    for (int i = 0; i < 500; i++) {
+      std::string w(9, 'a');
+      for (auto &c : w) {
+        c = (char)('a' + next() % 3);
+      }
+      words.push_back(w);
+    }
+    auto tree = qs::bk_tree<qs::string_view>(&qs::hamming_distance);
+    for (auto &w : words) {
+      auto view = qs::string_view(w.c_str());
+      if (tree.find(view) == nullptr) {
+        tree.insert(view);
+      }
+    }
+
+    THEN("the index finds what the tree finds for every split") {
+      qs::partition_index<qs::string_view> index{};
+      for (int max_dist = 0; max_dist <= 3; max_dist++) {
+        index.rebuild(tree, max_dist, &same_view);
+        for (int i = 0; i < 50; i++) {
+          auto q = qs::string_view(words[i].c_str());
+          for (int threshold = 0; threshold <= 3; threshold++) {
+            REQUIRE(partition_set(index.match(threshold, q)).get_size() ==
+                    partition_set(tree.match(threshold, q)).get_size());
+          }
+        }
+      }
+    }
+  }
+}
@@ -2,6 +2,9 @@
 
 #include <qs/queue.hpp>
 
+#include <atomic>
+#include <chrono>
+#include <memory>
 #include <thread>
 
 TEST_CASE("the concurrent queue works as expected", "[queue]") {
@@ -33,3 +36,107 @@ TEST_CASE("the concurrent queue works as expected", "[queue]") {
 
   REQUIRE(got == wanted);
 }
+
+TEST_CASE("the mpmc queue works as expected", "[queue]") {
+  SECTION("the capacity is rounded up to a power of two") {
+    qs::mpmc_queue<int> q{5};
+    REQUIRE(q.get_capacity() == 8);
+  }
+
+  SECTION("the try variants fail on a full and on an empty queue") {
+    qs::mpmc_queue<int> q{4};
+    int item;
+    REQUIRE_FALSE(q.try_dequeue(item));
+    for (int i = 0; i < 4; i++) {
+      REQUIRE(q.try_enqueue(i));
+    }
+    REQUIRE_FALSE(q.try_enqueue(4));
+    REQUIRE(q.size() == 4);
+    for (int i = 0; i < 4; i++) {
+      REQUIRE(q.try_dequeue(item));
+      REQUIRE(item == i);
+    }
+    REQUIRE_FALSE(q.try_dequeue(item));
+  }
+
+  SECTION("items wrap around the ring in order") {
+    qs::mpmc_queue<int> q{2};
+    for (int i = 0; i < 100; i++) {
+      REQUIRE(q.try_enqueue(i));
+      REQUIRE(q.dequeue().get() == i);
+    }
+  }
+
+  SECTION("items that are left in the queue are destroyed with it") {
+    auto shared = std::make_shared<int>(1);
+    {
+      qs::mpmc_queue<std::shared_ptr<int>> q{4};
+      q.try_enqueue(shared);
+      q.try_enqueue(shared);
+      REQUIRE(shared.use_count() == 3);
+    }
+    REQUIRE(shared.use_count() == 1);
+  }
+
+  SECTION("closing wakes up a blocked consumer") {
+    qs::mpmc_queue<int> q{4};
+    bool got_nothing = false;
+    std::thread consumer([&]() { got_nothing = q.dequeue().is_empty(); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    q.close();
+    consumer.join();
+    REQUIRE(got_nothing);
+  }
+
+  SECTION("closing wakes up a blocked producer") {
+    qs::mpmc_queue<int> q{2};
+    q.enqueue(1);
+    q.enqueue(2);
+    bool pushed = true;
+    std::thread producer([&]() { pushed = q.enqueue(3); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    q.close();
+    producer.join();
+    REQUIRE_FALSE(pushed);
+    REQUIRE(q.dequeue().get() == 1);
+    REQUIRE(q.dequeue().get() == 2);
+    REQUIRE(q.dequeue().is_empty());
+  }
+
+  SECTION("every item is delivered exactly once under contention") {
+    // A tiny ring so producers and consumers keep blocking on each other
+    qs::mpmc_queue<int> q{4};
+    const int producers = 4;
+    const int items = 20000;
+    std::atomic<long> sum{0};
+    std::atomic<int> received{0};
+    std::thread threads[producers * 2];
+    for (int p = 0; p < producers; p++) {
+      threads[p] = std::thread([&q, p]() {
+        for (int i = 0; i < items; i++) {
+          q.enqueue(p * items + i);
+        }
+      });
+    }
+    for (int c = 0; c < producers; c++) {
+      threads[producers + c] = std::thread([&]() {
+        while (received.load() < producers * items) {
+          int item;
+          if (q.try_dequeue(item)) {
+            sum += item;
+            received++;
+          }
+        }
+      });
+    }
+    for (auto &t : threads) {
+      t.join();
+    }
+    long wanted = 0;
+    for (long i = 0; i < producers * items; i++) {
+      wanted += i;
+    }
+    REQUIRE(received.load() == producers * items);
+    REQUIRE(sum.load() == wanted);
+  }
+}
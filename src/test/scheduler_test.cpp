@@ -0,0 +1,48 @@
+#include "catch_amalgamated.hpp"
+
+#include <qs/job.h>
+#include <qs/scheduler.hpp>
+
+#include <atomic>
+
+struct increment_job : public qs::job {
+  std::atomic<int> *counter;
+
+  explicit increment_job(std::atomic<int> *counter) : counter(counter) {}
+
+  void operator()() override { (*counter)++; }
+};
+
+TEST_CASE("the round robin scheduler runs every job", "[scheduler]") {
+  std::atomic<int> counter{0};
+
+  SECTION("with spinning workers") {
+    qs::scheduler sched{4};
+    for (int i = 0; i < 1000; i++) {
+      sched.submit_job(new increment_job(&counter));
+    }
+    sched.wait_all_finish();
+    REQUIRE(counter.load() == 1000);
+  }
+
+  SECTION("with workers that park right away") {
+    // Every round has to wake up a parked worker and wait for it while the
+    // worker may still be going to sleep
+    qs::scheduler sched{4, 0};
+    for (int i = 0; i < 1000; i++) {
+      sched.submit_job(new increment_job(&counter));
+      sched.wait_all_finish();
+      REQUIRE(counter.load() == i + 1);
+    }
+  }
+
+  SECTION("jobs that are still queued run before the scheduler is destroyed") {
+    {
+      qs::scheduler sched{2, 0};
+      for (int i = 0; i < 100; i++) {
+        sched.submit_job(new increment_job(&counter));
+      }
+    }
+    REQUIRE(counter.load() == 100);
+  }
+}
@@ -0,0 +1,45 @@
+#include "catch_amalgamated.hpp"
+
+#include <qs/memory.hpp>
+
+#include <thread>
+
+struct counted {
+  int *destroyed;
+  explicit counted(int *d) : destroyed(d) {}
+  ~counted() { (*destroyed)++; }
+};
+
+TEST_CASE("shared pointer shares ownership and deallocates once",
+          "[shared_pointer]") {
+  int destroyed = 0;
+  {
+    auto p = qs::make_shared<counted>(&destroyed);
+    REQUIRE(p.use_count() == 1);
+    {
+      auto copy = p;
+      REQUIRE(p.use_count() == 2);
+      REQUIRE(copy.get() == p.get());
+    }
+    REQUIRE(p.use_count() == 1);
+    REQUIRE(destroyed == 0);
+
+    auto moved = std::move(p);
+    REQUIRE(p.is_empty());
+    REQUIRE_THROWS(*p);
+    REQUIRE(moved.use_count() == 1);
+  }
+  REQUIRE(destroyed == 1);
+
+  SECTION("copies can be released from many threads") {
+    auto p = qs::make_shared<counted>(&destroyed);
+    std::thread threads[8];
+    for (auto &t : threads) {
+      t = std::thread([](qs::shared_pointer<counted> copy) { (void)copy; }, p);
+    }
+    for (auto &t : threads) {
+      t.join();
+    }
+    REQUIRE(p.use_count() == 1);
+  }
+}
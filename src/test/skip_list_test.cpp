@@ -44,6 +44,22 @@ SCENARIO("qs::skip_list behaves as expected", "[skip_list]") {
       }
     }
 
+    WHEN("we insert some strings and remove every other one") {
+      for (std::size_t i = 0; i < n; ++i) {
+        sl.insert(data[i]);
+      }
+      for (std::size_t i = 0; i < n; i += 2) {
+        sl.remove(data[i]);
+      }
+
+      THEN("only the strings that were kept are found") {
+        REQUIRE(sl.get_size() == n / 2);
+        for (std::size_t i = 0; i < n; ++i) {
+          REQUIRE((sl.find(data[i]) != sl.end()) == (i % 2 == 1));
+        }
+      }
+    }
+
     WHEN("we insert 2 strings that are the same") {
       sl.insert(data[0]);
       sl.insert(data[0]);
@@ -55,6 +55,28 @@ TEST_CASE("String view hash works", "[string_view]") {
   qs::string s{"edit"};
 
   REQUIRE(std::hash<qs::string_view>{}(sv) == std::hash<qs::string>{}(s));
+
+  SECTION("for every length") {
+    char buf[80];
+    for (std::size_t length = 1; length < sizeof(buf); length++) {
+      for (std::size_t i = 0; i < length; i++) {
+        buf[i] = (char)('a' + (i * 7 + length) % 26);
+      }
+      buf[length] = '\0';
+      qs::string_view view{buf, buf + length - 1};
+      auto hash = std::hash<qs::string_view>{}(view);
+      REQUIRE(hash == std::hash<qs::string>{}(qs::string{buf}));
+
+      // Changing any byte changes the hash and bytes past the end are not read
+      for (std::size_t i = 0; i < length; i++) {
+        buf[i] ^= 1;
+        REQUIRE(std::hash<qs::string_view>{}(view) != hash);
+        buf[i] ^= 1;
+      }
+      buf[length] = 'z';
+      REQUIRE(std::hash<qs::string_view>{}(view) == hash);
+    }
+  }
 }
 
 TEST_CASE("string_view vs string comparison works as expected",
@@ -257,3 +257,22 @@ TEST_CASE("vector iterator behaves correctly", "[vector]") {
     }
   }
 }
+
+TEST_CASE("vector clear keeps the buffer", "[vector]") {
+  auto v = construct_vector<qs::unique_pointer<obj>>(5, construct_pointer_obj);
+  auto buffer = v.get_data();
+  v.clear();
+  REQUIRE(v.get_size() == 0);
+  v.push(construct_pointer_obj(7));
+  REQUIRE(v.get_data() == buffer);
+  REQUIRE(*v.at(0) == obj(7, 7));
+}
+
+TEST_CASE("vector pop returns the last element", "[vector]") {
+  auto v = construct_vector<qs::unique_pointer<obj>>(3, construct_pointer_obj);
+  auto last = v.pop();
+  REQUIRE(*last == obj(2, 2));
+  REQUIRE(v.get_size() == 2);
+  v.push(construct_pointer_obj(9));
+  REQUIRE(*v.at(2) == obj(9, 9));
+}
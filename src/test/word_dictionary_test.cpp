@@ -0,0 +1,51 @@
+#include "catch_amalgamated.hpp"
+
+#include <qs/string.h>
+#include <qs/string_view.h>
+#include <qs/word_dictionary.hpp>
+
+#include <cstdio>
+
+TEST_CASE("the word dictionary interns words", "[word_dictionary]") {
+  qs::word_dictionary dict{};
+
+  SECTION("ids are dense and stable") {
+    REQUIRE(dict.intern(qs::string_view{"hello"}) == 0);
+    REQUIRE(dict.intern(qs::string_view{"world"}) == 1);
+    REQUIRE(dict.intern(qs::string_view{"hello"}) == 0);
+    REQUIRE(dict.get_size() == 2);
+    REQUIRE(dict.get(0).get_string_view() == "hello");
+    REQUIRE(dict.get(1).get_string_view() == "world");
+  }
+
+  SECTION("find does not add words") {
+    dict.intern(qs::string_view{"hello"});
+    REQUIRE(dict.find(qs::string_view{"hello"}) == 0);
+    REQUIRE(dict.find(qs::string_view{"world"}) == qs::word_dictionary::npos);
+    REQUIRE(dict.get_size() == 1);
+  }
+
+  SECTION("the dictionary keeps its own copy of the words") {
+    char buffer[] = "temporary";
+    auto id = dict.intern(qs::string_view{buffer});
+    buffer[0] = 'x';
+    REQUIRE(dict.get(id).get_string_view() == "temporary");
+    REQUIRE(dict.find(qs::string_view{"temporary"}) == id);
+  }
+
+  SECTION("slots do not move when the dictionary grows") {
+    auto first = &dict.get(dict.intern(qs::string_view{"first"}));
+    char word[16];
+    for (u32 i = 0; i < 3 * QS_DICTIONARY_CHUNK_SIZE; i++) {
+      std::snprintf(word, sizeof(word), "w%u", i);
+      dict.intern(qs::string_view{word});
+    }
+    REQUIRE(dict.get_size() == 3 * QS_DICTIONARY_CHUNK_SIZE + 1);
+    REQUIRE(&dict.get(0) == first);
+    REQUIRE(first->get_string_view() == "first");
+    std::snprintf(word, sizeof(word), "w%u", 2 * QS_DICTIONARY_CHUNK_SIZE);
+    auto id = dict.find(qs::string_view{word});
+    REQUIRE(id == 2 * QS_DICTIONARY_CHUNK_SIZE + 1);
+    REQUIRE(dict.get(id).get_string_view() == qs::string_view{word});
+  }
+}
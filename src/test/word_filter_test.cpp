@@ -0,0 +1,98 @@
+#include "catch_amalgamated.hpp"
+
+#include <qs/bk_tree.hpp>
+#include <qs/distances.hpp>
+#include <qs/flat_bk_tree.hpp>
+#include <qs/string_view.h>
+#include <qs/word_filter.hpp>
+
+#include <string>
+#include <vector>
+
+static int filter_bound(const char *a, const char *b) {
+  return qs::word_filter{qs::string_view(a)}.lower_bound(
+      qs::word_filter{qs::string_view(b)});
+}
+
+TEST_CASE("Word filter bounds the edit distance", "[word_filter]") {
+  SECTION("the bound of known pairs") {
+    REQUIRE(filter_bound("hello", "hello") == 0);
+    // Same letters in another order
+    REQUIRE(filter_bound("listen", "silent") == 0);
+    REQUIRE(filter_bound("abc", "abcd") == 1);
+    REQUIRE(filter_bound("aaaa", "bbbb") == 4);
+    REQUIRE(filter_bound("a", "abcdefgh") == 7);
+    REQUIRE(filter_bound("", "") == 0);
+  }
+
+  SECTION("is never above the edit distance of random words") {
+    u64 state = 3;
+    auto next = [&state]() {
+      state = state * 6364136223846793005ull + 1442695040888963407ull;
+      return state >> 33;
+    };
+    std::vector<std::string> words;
+    for (int i = 0; i < 300; i++) {
+      std::string w(1 + next() % 31, 'a');
+      for (auto &c : w) {
+        c = (char)('a' + next() % 6);
+      }
+      words.push_back(w);
+    }
+    for (std::size_t i = 0; i + 1 < words.size(); i++) {
+      auto a = qs::string_view(words[i].c_str());
+      auto b = qs::string_view(words[i + 1].c_str());
+      REQUIRE(qs::word_filter{a}.lower_bound(qs::word_filter{b}) <=
+              qs::edit_distance(a, b));
+    }
+  }
+
+  SECTION("is only kept for edit distances") {
+    REQUIRE(qs::has_word_filter(&qs::edit_distance));
+    REQUIRE(qs::has_word_filter(&qs::bit_parallel_edit_distance));
+    REQUIRE_FALSE(qs::has_word_filter(&qs::hamming_distance));
+  }
+}
+
+TEST_CASE("Flat BK-Tree skips the nodes its filters rule out",
+          "[word_filter]") {
+  std::vector<std::string> words;
+  u64 state = 7;
+  auto next = [&state]() {
+    state = state * 6364136223846793005ull + 1442695040888963407ull;
+    return state >> 33;
+  };
+  for (int i = 0; i < 400; i++) {
+    std::string w(4 + next() % 12, 'a');
+    for (auto &c : w) {
+      c = (char)('a' + next() % 8);
+    }
+    words.push_back(w);
+  }
+  auto tree = qs::bk_tree<qs::string_view>(&qs::edit_distance);
+  for (auto &w : words) {
+    auto view = qs::string_view(w.c_str());
+    if (tree.find(view) == nullptr) {
+      tree.insert(view);
+    }
+  }
+  qs::flat_bk_tree<qs::string_view> flat{tree};
+
+  qs::filter_stats stats{};
+  for (int i = 0; i < 50; i++) {
+    auto q = qs::string_view(words[i].c_str());
+    for (int threshold = 0; threshold <= 3; threshold++) {
+      std::size_t found = 0;
+      flat.traverse(
+          threshold, q,
+          [&](qs::string_view *w, int d) {
+            REQUIRE(d == qs::edit_distance(*w, q));
+            found++;
+          },
+          &stats);
+      REQUIRE(found == tree.match(threshold, q).get_size());
+    }
+  }
+  REQUIRE(stats.rejected > 0);
+  REQUIRE(stats.rejected < stats.checked);
+}
@@ -0,0 +1,164 @@
+#include "catch_amalgamated.hpp"
+
+#include <qs/work_stealing_deque.hpp>
+#include <qs/work_stealing_scheduler.hpp>
+
+#include <atomic>
+#include <thread>
+
+TEST_CASE("the work stealing deque works as expected", "[work_stealing]") {
+  qs::work_stealing_deque<int> d{2};
+
+  SECTION("the owner pops in LIFO order and thieves steal in FIFO order") {
+    for (int i = 0; i < 10; i++) {
+      d.push(i);
+    }
+    REQUIRE(d.size() == 10);
+    int item;
+    REQUIRE(d.pop(item));
+    REQUIRE(item == 9);
+    REQUIRE(d.steal(item));
+    REQUIRE(item == 0);
+    REQUIRE(d.size() == 8);
+  }
+
+  SECTION("an empty deque returns nothing") {
+    int item;
+    REQUIRE_FALSE(d.pop(item));
+    REQUIRE_FALSE(d.steal(item));
+  }
+
+  SECTION("every item is taken exactly once under contention") {
+    const int items = 100000;
+    std::atomic<long> sum{0};
+    std::atomic<int> taken{0};
+    std::thread thieves[4];
+    for (auto &t : thieves) {
+      t = std::thread([&]() {
+        int item;
+        while (taken.load() < items) {
+          if (d.steal(item)) {
+            sum += item;
+            taken++;
+          }
+        }
+      });
+    }
+    long wanted = 0;
+    for (int i = 0; i < items; i++) {
+      d.push(i);
+      wanted += i;
+      int item;
+      if (i % 3 == 0 && d.pop(item)) {
+        sum += item;
+        taken++;
+      }
+    }
+    int item;
+    while (d.pop(item)) {
+      sum += item;
+      taken++;
+    }
+    for (auto &t : thieves) {
+      t.join();
+    }
+    REQUIRE(taken.load() == items);
+    REQUIRE(sum.load() == wanted);
+  }
+}
+
+struct counting_job : public qs::job {
+  std::atomic<int> *counter;
+  qs::work_stealing_scheduler *sched;
+  int children;
+
+  counting_job(std::atomic<int> *counter, qs::work_stealing_scheduler *sched,
+               int children)
+      : counter(counter), sched(sched), children(children) {}
+
+  void operator()() override {
+    (*counter)++;
+    for (int i = 0; i < children; i++) {
+      sched->submit_job(new counting_job(counter, sched, 0));
+    }
+  }
+};
+
+TEST_CASE("the work stealing scheduler runs every job", "[work_stealing]") {
+  qs::work_stealing_scheduler sched{4};
+  std::atomic<int> counter{0};
+
+  SECTION("jobs submitted from outside the pool") {
+    for (int i = 0; i < 1000; i++) {
+      sched.submit_job(new counting_job(&counter, &sched, 0));
+    }
+    sched.wait_all_finish();
+    REQUIRE(counter.load() == 1000);
+
+    u64 executed = 0;
+    for (std::size_t i = 0; i < sched.get_workers_count(); i++) {
+      executed += sched.get_stats(i).executed;
+    }
+    REQUIRE(executed == 1000);
+    REQUIRE(sched.get_injector_depth() == 0);
+  }
+
+  SECTION("jobs submitted from inside other jobs") {
+    for (int i = 0; i < 100; i++) {
+      sched.submit_job(new counting_job(&counter, &sched, 10));
+    }
+    sched.wait_all_finish();
+    REQUIRE(counter.load() == 1100);
+  }
+}
+
+struct fork_join_job : public qs::job {
+  std::atomic<int> *counter;
+  qs::work_stealing_scheduler *sched;
+  int children;
+  bool *all_children_done;
+
+  fork_join_job(std::atomic<int> *counter, qs::work_stealing_scheduler *sched,
+                int children, bool *all_children_done)
+      : counter(counter), sched(sched), children(children),
+        all_children_done(all_children_done) {}
+
+  void operator()() override {
+    std::atomic<int> local{0};
+    qs::task_group group{*sched};
+    for (int i = 0; i < children; i++) {
+      group.spawn(new counting_job(&local, sched, 0));
+    }
+    group.wait();
+    *all_children_done = local.load() == children;
+    *counter += local.load();
+  }
+};
+
+TEST_CASE("task groups wait for the jobs they spawned", "[work_stealing]") {
+  qs::work_stealing_scheduler sched{2};
+  std::atomic<int> counter{0};
+
+  SECTION("waiting from outside the pool") {
+    qs::task_group group{sched};
+    for (int i = 0; i < 1000; i++) {
+      group.spawn(new counting_job(&counter, &sched, 0));
+    }
+    group.wait();
+    REQUIRE(counter.load() == 1000);
+  }
+
+  SECTION("waiting from inside a job with more parents than workers") {
+    // Every parent blocks a worker until its children are done so this only
+    // finishes because the waiting workers run the queued jobs themselves
+    bool done[16];
+    for (auto &d : done) {
+      sched.submit_job(new fork_join_job(&counter, &sched, 50, &d));
+    }
+    sched.wait_all_finish();
+    REQUIRE(counter.load() == 16 * 50);
+    for (auto d : done) {
+      REQUIRE(d);
+    }
+  }
+}